@@ -16,7 +16,6 @@
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/BasicBlock.h"
 
-#include "llvm/Bitcode/BitcodeWriter.h"
 #include "llvm/ADT/StringSet.h"
 #include "llvm/ADT/StringMap.h"
 #include "llvm/IRReader/IRReader.h"
@@ -30,52 +29,36 @@
 #include <utility>
 #include <stack>
 
-#include "symbol.h"
+#include "cmm.h"
 
 using namespace llvm;
 using namespace std;
 
-using parameter = pair<Type*,const char*>;
-using parameter_list = std::list<parameter>;
-
-typedef struct {
-  BasicBlock* expr;
-  BasicBlock* body;
-  BasicBlock* reinit;
-  BasicBlock* exit;
-} loop_info;
-
-stack<loop_info> loop_stack;
-
-int num_errors;
-
-extern int yylex();   /* lexical analyzer generated from lex.l */
-
-int yyerror(const char *error);
-int parser_error(const char*);
-
-void cmm_abort();
-char *get_filename();
-int get_lineno();
-
-int loops_found=0;
+Value* BuildFunction(cmm_context *ctx, Type* RetType, atom_t *name,
+			   parameter_list *params);
 
-extern Module *M;
-extern LLVMContext TheContext;
+%}
 
-Function *Fun;
-IRBuilder<> *Builder;
+%code requires {
+#include "cmm.h"
+}
 
-Value* BuildFunction(Type* RetType, const char *name,
-			   parameter_list *params);
+/* The parser and the scanner keep all their state in the context, so
+   that separate compilations can run concurrently */
+%define api.pure full
+%param {yyscan_t scanner}
+%parse-param {cmm_context *ctx}
 
-%}
+%code {
+int yylex(YYSTYPE *yylval_param, yyscan_t yyscanner);
+int yyerror(yyscan_t scanner, cmm_context *ctx, const char *error);
+}
 
 /* Data structure for tree nodes*/
 
 %union {
-  int inum;
-  char * id;
+  int64_t inum;
+  atom_t * id;
   Type*  type;
   Value* value;
   parameter_list *plist;
@@ -141,22 +124,22 @@ external_declaration:	  function_definition
 function_definition:	  type_specifier ID LPAREN param_list_opt RPAREN
 // NO MODIFICATION NEEDED
 {
-  symbol_push_scope();
-  BuildFunction($1,$2,$4);
+  if (cmm_push_scope(ctx) || BuildFunction(ctx,$1,$2,$4)==nullptr)
+    YYABORT;
 }
 compound_stmt
 {
-  symbol_pop_scope();
+  symbol_pop_scope(ctx->symtab);
 }
 
 | type_specifier STAR ID LPAREN param_list_opt RPAREN
 {
-  symbol_push_scope();
-  BuildFunction(PointerType::get($1,0),$3,$5);
+  if (cmm_push_scope(ctx) || BuildFunction(ctx,PointerType::get($1,0),$3,$5)==nullptr)
+    YYABORT;
 }
 compound_stmt
 {
-  symbol_pop_scope();
+  symbol_pop_scope(ctx->symtab);
 }
 ;
 
@@ -177,11 +160,11 @@ opt_initializer:   ASSIGN constant_expression { $$ = $2; } | { $$ = nullptr; } ;
 // NO MODIFICATION NEEDED
 type_specifier:		  INT
 {
-  $$ = Type::getInt64Ty(TheContext);
+  $$ = Type::getInt64Ty(ctx->TheContext);
 }
                      |    VOID
 {
-  $$ = Type::getVoidTy(TheContext);
+  $$ = Type::getVoidTy(ctx->TheContext);
 }
 ;
 
@@ -237,17 +220,19 @@ expr_stmt:	           SEMICOLON
 
 local_declaration:    type_specifier STAR ID opt_initializer SEMICOLON
 {
-  Value * ai = Builder->CreateAlloca(PointerType::get($1,0),0,$3); //allocate space
+  Value * ai = ctx->Builder->CreateAlloca(PointerType::get($1,0),0,atom_name($3)); //allocate space
   if (nullptr != $4)
-    Builder->CreateStore($4,ai); //if nullptr is not equal to ID, store in address of ID
-  symbol_insert($3,ai);
+    ctx->Builder->CreateStore($4,ai); //if nullptr is not equal to ID, store in address of ID
+  if (cmm_bind(ctx,$3,ai))
+    YYABORT;
 }
 | type_specifier ID opt_initializer SEMICOLON
 {
-  Value * ai = Builder->CreateAlloca($1,0,$2);
+  Value * ai = ctx->Builder->CreateAlloca($1,0,atom_name($2));
   if (nullptr != $3)
-    Builder->CreateStore($3,ai); //if nullptr is not equal to opt_initializer, store in address of opt_initializer
-  symbol_insert($2,ai);
+    ctx->Builder->CreateStore($3,ai); //if nullptr is not equal to opt_initializer, store in address of opt_initializer
+  if (cmm_bind(ctx,$2,ai))
+    YYABORT;
 }
 ;
 
@@ -261,13 +246,14 @@ local_declaration_list_opt:
 
 compound_stmt:		  LBRACE {
 
-  symbol_push_scope(); //push scope to record variables within compound statement
+  if (cmm_push_scope(ctx)) //push scope to record variables within compound statement
+    YYABORT;
 }
 local_declaration_list_opt
 statement_list_opt
 {
 
-  symbol_pop_scope(); //pop scope to remove variables no longer accessible
+  symbol_pop_scope(ctx->symtab); //pop scope to remove variables no longer accessible
 }
 RBRACE
 ;
@@ -293,28 +279,28 @@ continue_stmt:            CONTINUE SEMICOLON
 selection_stmt:
   IF LPAREN bool_expression RPAREN
  {
-  // make building blocks with BuildingBlock::Create(M->getContext(), "if.then", Fun)
+  // make building blocks with BuildingBlock::Create(ctx->M->getContext(), "if.then", ctx->Fun)
   // push_loop(NULL, all three BBs)
-  BasicBlock* body = BasicBlock::Create(M->getContext(), "if.then", Fun);
-  BasicBlock* reinit = BasicBlock::Create(M->getContext(), "if.body", Fun);
-  BasicBlock* exit = BasicBlock::Create(M->getContext(), "if.exit", Fun);
+  BasicBlock* body = BasicBlock::Create(ctx->M->getContext(), "if.then", ctx->Fun);
+  BasicBlock* reinit = BasicBlock::Create(ctx->M->getContext(), "if.body", ctx->Fun);
+  BasicBlock* exit = BasicBlock::Create(ctx->M->getContext(), "if.exit", ctx->Fun);
   loop_info info = {NULL, body, reinit, exit};
-  loop_stack.push(info);
-  Value* val = Builder->CreateICmpNE($3, Builder->getInt64(0), "icmp.if"); //compare bool_expression with 0
-  Builder->CreateCondBr(val, body, reinit); //create a conditional branch
-  Builder->SetInsertPoint(body); //specify body should be appended to the end of this block
+  ctx->loop_stack.push(info);
+  Value* val = ctx->Builder->CreateICmpNE($3, ctx->Builder->getInt64(0), "icmp.if"); //compare bool_expression with 0
+  ctx->Builder->CreateCondBr(val, body, reinit); //create a conditional branch
+  ctx->Builder->SetInsertPoint(body); //specify body should be appended to the end of this block
  }
  statement
  {
-  loop_info curr = loop_stack.top();
-  Builder->CreateBr(curr.exit);
-  Builder->SetInsertPoint(curr.exit);
+  loop_info curr = ctx->loop_stack.top();
+  ctx->Builder->CreateBr(curr.exit);
+  ctx->Builder->SetInsertPoint(curr.exit);
  } ELSE statement
  {
-  loop_info curr = loop_stack.top();
-  Builder->CreateBr(curr.exit);
-  Builder->SetInsertPoint(curr.exit); //specify curr.exit should be appended to the end of this block
-  loop_stack.pop();
+  loop_info curr = ctx->loop_stack.top();
+  ctx->Builder->CreateBr(curr.exit);
+  ctx->Builder->SetInsertPoint(curr.exit); //specify curr.exit should be appended to the end of this block
+  ctx->loop_stack.pop();
  }
 | SWITCH LPAREN expression RPAREN statement {
 
@@ -324,60 +310,60 @@ selection_stmt:
 
 iteration_stmt: WHILE
 {
-  BasicBlock* expr = BasicBlock::Create(M->getContext(), "w.expr", Fun);
-  Builder->CreateBr(expr);
-  Builder->SetInsertPoint(expr);
+  BasicBlock* expr = BasicBlock::Create(ctx->M->getContext(), "w.expr", ctx->Fun);
+  ctx->Builder->CreateBr(expr);
+  ctx->Builder->SetInsertPoint(expr);
   $<bb>$ = expr;
 }
 LPAREN bool_expression RPAREN
 {
-  BasicBlock* body = BasicBlock::Create(M->getContext(), "w.body", Fun);
-  BasicBlock* exit = BasicBlock::Create(M->getContext(), "w.exit", Fun);
-  Builder->CreateCondBr(Builder->CreateICmpNE($4, Builder->getInt64(0)), body, exit); //create a conditional branch
-  Builder->SetInsertPoint(body); //specify body should be appended to the end of this block
+  BasicBlock* body = BasicBlock::Create(ctx->M->getContext(), "w.body", ctx->Fun);
+  BasicBlock* exit = BasicBlock::Create(ctx->M->getContext(), "w.exit", ctx->Fun);
+  ctx->Builder->CreateCondBr(ctx->Builder->CreateICmpNE($4, ctx->Builder->getInt64(0)), body, exit); //create a conditional branch
+  ctx->Builder->SetInsertPoint(body); //specify body should be appended to the end of this block
   $<bb>$ = exit;
 }
 statement
 {
-  Builder->CreateBr($<bb>2);
-  Builder->SetInsertPoint($<bb>6);
+  ctx->Builder->CreateBr($<bb>2);
+  ctx->Builder->SetInsertPoint($<bb>6);
 }
 | FOR LPAREN expr_opt SEMICOLON
 {
 /*
-  BasicBlock* expr = BasicBlock::Create(M->getContext(), "f.expr", Fun);
-  BasicBlock* body = BasicBlock::Create(M->getContext(), "f.body", Fun);
-  BasicBlock* incr = BasicBlock::Create(M->getContext(), "f.incr", Fun);
-  BasicBlock* exit = BasicBlock::Create(M->getContext(), "f.exit", Fun);
-  loop_stack.push({expr, body, incr, exit});
-  Builder->CreateBr(expr); //for
-  Builder->SetInsertPoint(expr);
+  BasicBlock* expr = BasicBlock::Create(ctx->M->getContext(), "f.expr", ctx->Fun);
+  BasicBlock* body = BasicBlock::Create(ctx->M->getContext(), "f.body", ctx->Fun);
+  BasicBlock* incr = BasicBlock::Create(ctx->M->getContext(), "f.incr", ctx->Fun);
+  BasicBlock* exit = BasicBlock::Create(ctx->M->getContext(), "f.exit", ctx->Fun);
+  ctx->loop_stack.push({expr, body, incr, exit});
+  ctx->Builder->CreateBr(expr); //for
+  ctx->Builder->SetInsertPoint(expr);
 */
 }
 bool_expression SEMICOLON
 {
 /*
-  loop_info loop = loop_stack.top();
-  Value* val = Builder->CreateICmpNE($5, Builder->getInt64(0), "f.bool");
-  Builder->CreateCondBr(val, loop.body, loop.exit);
-  Builder->SetInsertPoint(loop.reinit);
+  loop_info loop = ctx->loop_stack.top();
+  Value* val = ctx->Builder->CreateICmpNE($5, ctx->Builder->getInt64(0), "f.bool");
+  ctx->Builder->CreateCondBr(val, loop.body, loop.exit);
+  ctx->Builder->SetInsertPoint(loop.reinit);
 */
 }
 expr_opt
 {
 /*
-  loop_info loop = loop_stack.top();
-  Builder->CreateBr(loop.expr);
-  Builder->SetInsertPoint(loop.body);
+  loop_info loop = ctx->loop_stack.top();
+  ctx->Builder->CreateBr(loop.expr);
+  ctx->Builder->SetInsertPoint(loop.body);
 */
 }
 RPAREN statement
 {
 /*
-  loop_info loop = loop_stack.top();
-  Builder->CreateBr(loop.reinit);
-  Builder->SetInsertPoint(loop.exit);
-  loop_stack.pop();
+  loop_info loop = ctx->loop_stack.top();
+  ctx->Builder->CreateBr(loop.reinit);
+  ctx->Builder->SetInsertPoint(loop.exit);
+  ctx->loop_stack.pop();
   */
 }
 | DO statement WHILE LPAREN bool_expression RPAREN SEMICOLON
@@ -391,12 +377,12 @@ expr_opt:
 return_stmt:		  RETURN SEMICOLON
 {
  //return create retvoid isntead of null_ptr
- $$ = Builder->CreateRetVoid();
+ $$ = ctx->Builder->CreateRetVoid();
 }
 | RETURN expression SEMICOLON
 {
  // return expression as a return ins
- $$ = Builder->CreateRet($2);
+ $$ = ctx->Builder->CreateRet($2);
 }
 ;
 
@@ -410,7 +396,7 @@ bool_expression: expression
 assign_expression:
   lvalue_location ASSIGN expression
 {
-  $$ = Builder->CreateStore($3, $1);
+  $$ = ctx->Builder->CreateStore($3, $1);
 }
 | expression
 {
@@ -425,79 +411,79 @@ expression: unary_expression
 | expression BITWISE_OR expression
 {
   //bitwise_or operation in LLVM
-  $$ = Builder->CreateOr($1,$3);
+  $$ = ctx->Builder->CreateOr($1,$3);
 }
 | expression BITWISE_XOR expression
 {
-  $$ = Builder->CreateXor($1,$3);
+  $$ = ctx->Builder->CreateXor($1,$3);
 }
 | expression AMPERSAND expression
 {
-  $$ = Builder->CreateAnd($1,$3);
+  $$ = ctx->Builder->CreateAnd($1,$3);
 }
 | expression EQ expression
 {
-  Value* val = Builder->CreateICmpEQ($1,$3);
-  $$ = Builder->CreateSelect(val, Builder->getInt64(1), Builder->getInt64(0));
+  Value* val = ctx->Builder->CreateICmpEQ($1,$3);
+  $$ = ctx->Builder->CreateSelect(val, ctx->Builder->getInt64(1), ctx->Builder->getInt64(0));
   // return second if true, third if false
 }
 | expression NEQ expression
 {
-  Value* val = Builder->CreateICmpNE($1,$3);
-  $$ = Builder->CreateSelect(val, Builder->getInt64(1), Builder->getInt64(0));
+  Value* val = ctx->Builder->CreateICmpNE($1,$3);
+  $$ = ctx->Builder->CreateSelect(val, ctx->Builder->getInt64(1), ctx->Builder->getInt64(0));
   // return second if true, third if false
 }
 | expression LT expression
 {
-  Value* val = Builder->CreateICmpSLT($1,$3);
-  $$ = Builder->CreateSelect(val, Builder->getInt64(1), Builder->getInt64(0));
+  Value* val = ctx->Builder->CreateICmpSLT($1,$3);
+  $$ = ctx->Builder->CreateSelect(val, ctx->Builder->getInt64(1), ctx->Builder->getInt64(0));
   // return second if true, third if false
 }
 | expression GT expression
 {
-  Value* val = Builder->CreateICmpSGT($1,$3);
-  $$ = Builder->CreateSelect(val, Builder->getInt64(1), Builder->getInt64(0));
+  Value* val = ctx->Builder->CreateICmpSGT($1,$3);
+  $$ = ctx->Builder->CreateSelect(val, ctx->Builder->getInt64(1), ctx->Builder->getInt64(0));
   // return second if true, third if false
 }
 | expression LTE expression
 {
-  Value* val = Builder->CreateICmpSLE($1,$3);
-  $$ = Builder->CreateSelect(val, Builder->getInt64(1), Builder->getInt64(0));
+  Value* val = ctx->Builder->CreateICmpSLE($1,$3);
+  $$ = ctx->Builder->CreateSelect(val, ctx->Builder->getInt64(1), ctx->Builder->getInt64(0));
   // return second if true, third if false
 }
 | expression GTE expression
 {
-  Value* val = Builder->CreateICmpSGE($1,$3);
-  $$ = Builder->CreateSelect(val, Builder->getInt64(1), Builder->getInt64(0));
+  Value* val = ctx->Builder->CreateICmpSGE($1,$3);
+  $$ = ctx->Builder->CreateSelect(val, ctx->Builder->getInt64(1), ctx->Builder->getInt64(0));
   // return second if true, third if false
 }
 | expression LSHIFT expression
 {
-  $$ = Builder->CreateShl($1,$3);
+  $$ = ctx->Builder->CreateShl($1,$3);
 }
 | expression RSHIFT expression
 {
-  $$ = Builder->CreateAShr($1,$3);
+  $$ = ctx->Builder->CreateAShr($1,$3);
 }
 | expression PLUS expression
 {
-  $$ = Builder->CreateAdd($1,$3);
+  $$ = ctx->Builder->CreateAdd($1,$3);
 }
 | expression MINUS expression
 {
-  $$ = Builder->CreateSub($1,$3);
+  $$ = ctx->Builder->CreateSub($1,$3);
 }
 | expression STAR expression
 {
-  $$ = Builder->CreateMul($1,$3);
+  $$ = ctx->Builder->CreateMul($1,$3);
 }
 | expression DIV expression
 {
-  $$ = Builder->CreateSDiv($1,$3);
+  $$ = ctx->Builder->CreateSDiv($1,$3);
 }
 | expression MOD expression
 {
-  $$ = Builder->CreateSRem($1,$3);
+  $$ = ctx->Builder->CreateSRem($1,$3);
 }
 | BOOL LPAREN expression RPAREN
 {
@@ -506,26 +492,26 @@ expression: unary_expression
 | I2P LPAREN expression RPAREN
 {
   Value* val = $3;
-  $$ = Builder->CreateIntToPtr(val, Type::getVoidTy(TheContext));
+  $$ = ctx->Builder->CreateIntToPtr(val, Type::getVoidTy(ctx->TheContext));
 }
 | P2I LPAREN expression RPAREN
 {
   Value* val = $3;
-  $$ = Builder->CreatePtrToInt(val, Type::getVoidTy(TheContext));
+  $$ = ctx->Builder->CreatePtrToInt(val, Type::getVoidTy(ctx->TheContext));
 }
 | ZEXT LPAREN expression RPAREN
 {
   Value* val = $3;
-  $$ = Builder->CreateZExt(val, Type::getInt64Ty(TheContext));
+  $$ = ctx->Builder->CreateZExt(val, Type::getInt64Ty(ctx->TheContext));
 }
 | SEXT LPAREN expression RPAREN
 {
   Value* val = $3;
-  $$ = Builder->CreateSExt(val, Type::getInt64Ty(TheContext));
+  $$ = ctx->Builder->CreateSExt(val, Type::getInt64Ty(ctx->TheContext));
 }
 | ID LPAREN argument_list_opt RPAREN
 {
-  $$ = Builder->CreateCall(M->getFunction($1), makeArrayRef($3));
+  $$ = ctx->Builder->CreateCall(symbol_find_function(ctx->symtab,$1), makeArrayRef($3));
 }
 | LPAREN expression RPAREN
 {
@@ -551,7 +537,7 @@ unary_expression: primary_expression
 | STAR primary_expression
 | MINUS unary_expression //do this
 {
-  $$ = Builder->CreateNeg($2);
+  $$ = ctx->Builder->CreateNeg($2);
 }
 | PLUS unary_expression
 {
@@ -559,14 +545,14 @@ unary_expression: primary_expression
 }
 | BITWISE_INVERT unary_expression
 {
-  $$ = Builder->CreateNot($2);
+  $$ = ctx->Builder->CreateNot($2);
 }
 ;
 
 primary_expression:
   lvalue_location
   {
-    $$ = Builder->CreateLoad($1);
+    $$ = ctx->Builder->CreateLoad($1);
   }
 | constant
 {
@@ -577,7 +563,7 @@ primary_expression:
 lvalue_location:
   ID
 {
-  $$ = symbol_find($1);
+  $$ = symbol_find(ctx->symtab,$1);
 }
 | lvalue_location LBRACKET expression RBRACKET
 | STAR LPAREN expression RPAREN
@@ -591,64 +577,64 @@ constant_expression:
 | constant_expression BITWISE_OR expression
 {
   //bitwise_or operation in LLVM
-  $$ = Builder->CreateOr($1,$3);
+  $$ = ctx->Builder->CreateOr($1,$3);
 }
 | constant_expression BITWISE_XOR expression
 {
-  $$ = Builder->CreateXor($1,$3);
+  $$ = ctx->Builder->CreateXor($1,$3);
 }
 | constant_expression AMPERSAND expression
 {
-  $$ = Builder->CreateAnd($1,$3);
+  $$ = ctx->Builder->CreateAnd($1,$3);
 }
 | constant_expression EQ expression
 {
-  Value* val = Builder->CreateICmpEQ($1,$3);
-  $$ = Builder->CreateSelect(val, Builder->getInt64(1), Builder->getInt64(0));
+  Value* val = ctx->Builder->CreateICmpEQ($1,$3);
+  $$ = ctx->Builder->CreateSelect(val, ctx->Builder->getInt64(1), ctx->Builder->getInt64(0));
   // return second if true, third if false
 }
 | constant_expression NEQ expression
 {
-  Value* val = Builder->CreateICmpNE($1,$3);
-  $$ = Builder->CreateSelect(val, Builder->getInt64(1), Builder->getInt64(0));
+  Value* val = ctx->Builder->CreateICmpNE($1,$3);
+  $$ = ctx->Builder->CreateSelect(val, ctx->Builder->getInt64(1), ctx->Builder->getInt64(0));
   // return second if true, third if false
 }
 | constant_expression LT expression
 {
-  Value* val = Builder->CreateICmpSLT($1,$3);
-  $$ = Builder->CreateSelect(val, Builder->getInt64(1), Builder->getInt64(0));
+  Value* val = ctx->Builder->CreateICmpSLT($1,$3);
+  $$ = ctx->Builder->CreateSelect(val, ctx->Builder->getInt64(1), ctx->Builder->getInt64(0));
   // return second if true, third if false
 }
 | constant_expression GT expression
 {
-  Value* val = Builder->CreateICmpSGT($1,$3);
-  $$ = Builder->CreateSelect(val, Builder->getInt64(1), Builder->getInt64(0));
+  Value* val = ctx->Builder->CreateICmpSGT($1,$3);
+  $$ = ctx->Builder->CreateSelect(val, ctx->Builder->getInt64(1), ctx->Builder->getInt64(0));
   // return second if true, third if false
 }
 | constant_expression LTE expression
 {
-  Value* val = Builder->CreateICmpSLE($1,$3);
-  $$ = Builder->CreateSelect(val, Builder->getInt64(1), Builder->getInt64(0));
+  Value* val = ctx->Builder->CreateICmpSLE($1,$3);
+  $$ = ctx->Builder->CreateSelect(val, ctx->Builder->getInt64(1), ctx->Builder->getInt64(0));
   // return second if true, third if false
 }
 | constant_expression GTE expression
 {
-  Value* val = Builder->CreateICmpSGE($1,$3);
-  $$ = Builder->CreateSelect(val, Builder->getInt64(1), Builder->getInt64(0));
+  Value* val = ctx->Builder->CreateICmpSGE($1,$3);
+  $$ = ctx->Builder->CreateSelect(val, ctx->Builder->getInt64(1), ctx->Builder->getInt64(0));
   // return second if true, third if false
 }
 | constant_expression LSHIFT expression
 {
-  $$ = Builder->CreateShl($1,$3);
+  $$ = ctx->Builder->CreateShl($1,$3);
 }
 
 | constant_expression RSHIFT expression
 {
-  $$ = Builder->CreateAShr($1,$3);
+  $$ = ctx->Builder->CreateAShr($1,$3);
 }
 
 | constant_expression PLUS expression
 {
-  $$ = Builder->CreateAdd($1,$3);
+  $$ = ctx->Builder->CreateAdd($1,$3);
 }
 | constant_expression MINUS expression
@@ -0,0 +1,107 @@
+#ifndef CMM_H
+#define CMM_H
+
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Type.h"
+#include "llvm/IR/IRBuilder.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <memory>
+#include <list>
+#include <stack>
+#include <utility>
+
+#include "symbol.h"
+
+using namespace llvm;
+
+using parameter = std::pair<Type*,atom_t*>;
+using parameter_list = std::list<parameter>;
+
+typedef struct {
+  BasicBlock* expr;
+  BasicBlock* body;
+  BasicBlock* reinit;
+  BasicBlock* exit;
+} loop_info;
+
+/* CMM_VERIFY_SCANNER checks the hand-written scanner against flex, so
+   it has to be built in */
+#if defined(CMM_VERIFY_SCANNER) && !defined(CMM_SIMD_SCANNER)
+#define CMM_SIMD_SCANNER
+#endif
+
+/* Where the hand-written scanner (scan.cpp) is in a source held in
+   memory.  When shadowing flex it copies names and leaves errors to flex. */
+typedef struct {
+  const char *cur;
+  const char *end;                  /* NULL when flex is doing the scanning */
+  int line;
+  bool shadow;
+} scan_state;
+
+#ifndef YY_TYPEDEF_YY_SCANNER_T
+#define YY_TYPEDEF_YY_SCANNER_T
+typedef void* yyscan_t;
+#endif
+
+/* Everything one compilation needs.  The parser and scanner are pure and
+   keep their state here, and every compilation owns its LLVMContext, so
+   any number of files can be compiled at once on different threads. */
+struct cmm_context
+{
+  LLVMContext TheContext;
+  std::unique_ptr<Module> M;        /* destroyed before TheContext */
+
+  std::unique_ptr<IRBuilder<>> Builder;
+  Function *Fun;
+  std::stack<loop_info> loop_stack;
+
+  symtab_t *symtab;
+  yyscan_t scanner;
+  scan_state scan;
+
+  /* the input when it was mapped rather than read; identifiers point
+     into it, so it is only unmapped with the context */
+  char *source;
+  size_t source_size;
+
+  const char *filename;
+  int line_num;
+  int num_errors;
+  int loops_found;
+
+  cmm_context(const char *filename);
+  ~cmm_context();
+};
+
+/* Parse 'in' into ctx->M.  Returns the number of errors reported. */
+int cmm_parse(cmm_context *ctx, FILE *in);
+/* As cmm_parse, but scans the file in place from a private mapping of it
+   when it is a regular file */
+int cmm_parse_file(cmm_context *ctx, const char *path);
+
+int parser_error(cmm_context *ctx, const char *msg);
+void lexical_error(cmm_context *ctx, const char *msg);
+int internal_error(cmm_context *ctx, const char *msg);
+
+/* The symbol table calls the grammar makes, reporting running out of
+   memory against the compilation; nonzero means the parse should stop */
+static inline int cmm_push_scope(cmm_context *ctx)
+{
+  if (symbol_push_scope(ctx->symtab))
+    return internal_error(ctx, "out of memory opening a scope");
+  return 0;
+}
+
+static inline int cmm_bind(cmm_context *ctx, atom_t *name, Value *val)
+{
+  if (symbol_insert(ctx->symtab, name, val))
+    return internal_error(ctx, "out of memory binding a name");
+  return 0;
+}
+
+#endif
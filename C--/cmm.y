@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <sys/mman.h>
 
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Value.h"
@@ -10,7 +11,6 @@
 #include "llvm/IR/Type.h"
 #include "llvm/IR/IRBuilder.h"
 
-#include "llvm/Bitcode/BitcodeWriter.h"
 #include "llvm/ADT/StringSet.h"
 #include "llvm/ADT/StringMap.h"
 #include "llvm/IRReader/IRReader.h"
@@ -24,52 +24,36 @@
 #include <utility>
 #include <stack>
 
-#include "symbol.h"
-  
+#include "cmm.h"
+
 using namespace llvm;
 using namespace std;
 
-using parameter = pair<Type*,const char*>;
-using parameter_list = std::list<parameter>;
-
-typedef struct {
-  BasicBlock* expr;
-  BasicBlock* body;
-  BasicBlock* reinit;
-  BasicBlock* exit;
-} loop_info;
-
-stack<loop_info> loop_stack;
- 
-int num_errors;
-
-extern int yylex();   /* lexical analyzer generated from lex.l */
-
-int yyerror(const char *error);
-int parser_error(const char*);
-
-void cmm_abort();
-char *get_filename();
-int get_lineno();
+Value* BuildFunction(cmm_context *ctx, Type* RetType, atom_t *name,
+			   parameter_list *params);
 
-int loops_found=0;
+%}
 
-extern Module *M;
-extern LLVMContext TheContext;
- 
-Function *Fun;
-IRBuilder<> *Builder;
+%code requires {
+#include "cmm.h"
+}
 
-Value* BuildFunction(Type* RetType, const char *name, 
-			   parameter_list *params);
+/* The parser and the scanner keep all their state in the context, so
+   that separate compilations can run concurrently */
+%define api.pure full
+%param {yyscan_t scanner}
+%parse-param {cmm_context *ctx}
 
-%}
+%code {
+int yylex(YYSTYPE *yylval_param, yyscan_t yyscanner);
+int yyerror(yyscan_t scanner, cmm_context *ctx, const char *error);
+}
 
 /* Data structure for tree nodes*/
 
 %union {
-  int inum;
-  char * id;
+  int64_t inum;
+  atom_t * id;
   Type*  type;
   Value* value;
   parameter_list *plist;
@@ -131,23 +115,23 @@ external_declaration:	  function_definition
 function_definition:	  type_specifier ID LPAREN param_list_opt RPAREN
 // NO MODIFICATION NEEDED
 {
-  symbol_push_scope();
-  BuildFunction($1,$2,$4);
+  if (cmm_push_scope(ctx) || BuildFunction(ctx,$1,$2,$4)==nullptr)
+    YYABORT;
 }
 compound_stmt 
 {
-  symbol_pop_scope();
+  symbol_pop_scope(ctx->symtab);
 }
 
 // NO MODIFICATION NEEDED
 | type_specifier STAR ID LPAREN param_list_opt RPAREN
 {
-  symbol_push_scope();
-  BuildFunction(PointerType::get($1,0),$3,$5);
+  if (cmm_push_scope(ctx) || BuildFunction(ctx,PointerType::get($1,0),$3,$5)==nullptr)
+    YYABORT;
 }
 compound_stmt
 {
-  symbol_pop_scope();
+  symbol_pop_scope(ctx->symtab);
 }
 ;
 
@@ -169,11 +153,11 @@ opt_initializer:   ASSIGN constant_expression { $$ = nullptr; } | { $$ = nullptr
 // NO MODIFICATION NEEDED
 type_specifier:		  INT
 {
-  $$ = Type::getInt64Ty(TheContext);
+  $$ = Type::getInt64Ty(ctx->TheContext);
 }
                      |    VOID
 {
-  $$ = Type::getVoidTy(TheContext);
+  $$ = Type::getVoidTy(ctx->TheContext);
 }
 ;
 
@@ -229,17 +213,19 @@ expr_stmt:	           SEMICOLON
 
 local_declaration:    type_specifier STAR ID opt_initializer SEMICOLON
 {
-  Value * ai = Builder->CreateAlloca(PointerType::get($1,0),0,$3);
+  Value * ai = ctx->Builder->CreateAlloca(PointerType::get($1,0),0,atom_name($3));
   if (nullptr != $4)
-    Builder->CreateStore($4,ai);
-  symbol_insert($3,ai);
+    ctx->Builder->CreateStore($4,ai);
+  if (cmm_bind(ctx,$3,ai))
+    YYABORT;
 }
 | type_specifier ID opt_initializer SEMICOLON
 {
-  Value * ai = Builder->CreateAlloca($1,0,$2);
+  Value * ai = ctx->Builder->CreateAlloca($1,0,atom_name($2));
   if (nullptr != $3)
-    Builder->CreateStore($3,ai);
-  symbol_insert($2,ai);  
+    ctx->Builder->CreateStore($3,ai);
+  if (cmm_bind(ctx,$2,ai))
+    YYABORT;
 }
 ;
 
@@ -253,13 +239,14 @@ local_declaration_list_opt:
 
 compound_stmt:		  LBRACE {
   // PUSH SCOPE TO RECORD VARIABLES WITHIN COMPOUND STATEMENT
-  symbol_push_scope();
+  if (cmm_push_scope(ctx))
+    YYABORT;
 }
 local_declaration_list_opt
 statement_list_opt 
 {
   // POP SCOPE TO REMOVE VARIABLES NO LONGER ACCESSIBLE
-  symbol_pop_scope();
+  symbol_pop_scope(ctx->symtab);
 }
 RBRACE
 ;
@@ -392,18 +379,18 @@ unary_constant_expression:
 
 constant:	          CONSTANT_INTEGER
 {
-  $$ = Builder->getInt64($1);
+  $$ = ctx->Builder->getInt64($1);
 }
 ;
 
 
 %%
 
-Value* BuildFunction(Type* RetType, const char *name, 
+Value* BuildFunction(cmm_context *ctx, Type* RetType, atom_t *name, 
 			   parameter_list *params)
 {
   std::vector<Type*> v;
-  std::vector<const char*> vname;
+  std::vector<atom_t*> vname;
 
   if (params)
     for(auto ii : *params)
@@ -416,97 +403,63 @@ Value* BuildFunction(Type* RetType, const char *name,
 
   FunctionType* FunType = FunctionType::get(RetType,Params,false);
 
-  Fun = Function::Create(FunType,GlobalValue::ExternalLinkage,
-			 name,M);
+  ctx->Fun = Function::Create(FunType,GlobalValue::ExternalLinkage,
+			 atom_name(name),ctx->M.get());
   Twine T("entry");
-  BasicBlock *BB = BasicBlock::Create(M->getContext(),T,Fun);
+  BasicBlock *BB = BasicBlock::Create(ctx->M->getContext(),T,ctx->Fun);
 
   /* Create an Instruction Builder */
-  Builder = new IRBuilder<>(M->getContext());
-  Builder->SetInsertPoint(BB);
+  ctx->Builder.reset(new IRBuilder<>(ctx->M->getContext()));
+  ctx->Builder->SetInsertPoint(BB);
 
-  Function::arg_iterator I = Fun->arg_begin();
-  for(int i=0; I!=Fun->arg_end();i++, I++)
+  Function::arg_iterator I = ctx->Fun->arg_begin();
+  for(int i=0; I!=ctx->Fun->arg_end();i++, I++)
     {
       // map args and create allocas!
-      AllocaInst *AI = Builder->CreateAlloca(v[i]);
-      Builder->CreateStore(&(*I),(Value*)AI);
-      symbol_insert(vname[i],(Value*)AI);
+      AllocaInst *AI = ctx->Builder->CreateAlloca(v[i]);
+      ctx->Builder->CreateStore(&(*I),(Value*)AI);
+      if (cmm_bind(ctx,vname[i],(Value*)AI))
+        {
+          delete params;
+          return nullptr;
+        }
     }
 
+  delete params;
 
-  return Fun;
+  return ctx->Fun;
 }
 
-extern int verbose;
-extern int line_num;
-extern char *infile[];
-static int   infile_cnt=0;
-extern FILE * yyin;
-extern int use_stdin;
-
-int parser_error(const char *msg)
+cmm_context::cmm_context(const char *filename)
+  : M(new Module(filename,TheContext)), Fun(nullptr),
+    symtab(symtab_create(M.get())), scanner(nullptr), scan(),
+    source(nullptr), source_size(0), filename(filename), line_num(1), num_errors(0), loops_found(0)
 {
-  if (use_stdin)
-    printf("stdin:%d: Error -- %s\n",line_num,msg);
-  else
-    printf("%s:%d: Error -- %s\n",infile[infile_cnt-1],line_num,msg);
-  return 1;
 }
 
-int internal_error(const char *msg)
+cmm_context::~cmm_context()
 {
-  printf("%s:%d Internal Error -- %s\n",infile[infile_cnt-1],line_num,msg);
-  return 1;
+  symtab_destroy(symtab);
+  if (source)
+    munmap(source,source_size);
 }
 
-int yywrap() {
-
-  if (use_stdin)
-    {
-      yyin = stdin;
-      return 0;
-    }
-  
-  static FILE * currentFile = NULL;
-
-  if ( (currentFile != 0) ) {
-    fclose(yyin);
-  }
-  
-  if(infile[infile_cnt]==NULL)
-    return 1;
-
-  currentFile = fopen(infile[infile_cnt],"r");
-  if(currentFile!=NULL)
-    yyin = currentFile;
-  else
-    printf("Could not open file: %s",infile[infile_cnt]);
-
-  infile_cnt++;
-  
-  return (currentFile)?0:1;
-}
-
-int yyerror(const char* error)
+int parser_error(cmm_context *ctx, const char *msg)
 {
-  parser_error("Un-resolved syntax error.");
+  printf("%s:%d: Error -- %s\n",ctx->filename,ctx->line_num,msg);
+  ctx->num_errors++;
   return 1;
 }
 
-char * get_filename()
-{
-  return infile[infile_cnt-1];
-}
-
-int get_lineno()
+int internal_error(cmm_context *ctx, const char *msg)
 {
-  return line_num;
+  printf("%s:%d Internal Error -- %s\n",ctx->filename,ctx->line_num,msg);
+  ctx->num_errors++;
+  return 1;
 }
 
-
-void cmm_abort()
+int yyerror(yyscan_t, cmm_context *ctx, const char*)
 {
-  parser_error("Too many errors to continue.");
-  exit(1);
+  parser_error(ctx,"Un-resolved syntax error.");
+  return 1;
 }
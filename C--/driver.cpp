@@ -0,0 +1,280 @@
+/* * * * * * * * * * * * * * * * * * * *\
+|            C-- driver                 |
+\* * * * * * * * * * * * * * * * * * * */
+
+/* Compiles any number of C-- files to bitcode in one process.  Every file
+   gets a cmm_context of its own, LLVMContext included, so the files are
+   compiled side by side on a thread pool:
+
+     cmm [-v] [-O] [-n] [-j N] [-o out.bc] file.c ...
+
+   Each file.c is written to file.bc unless -o names the output of a
+   single input.  With no files the program is read from stdin.
+
+   -O runs the CSE/ optimizer on the module the parser built, in memory,
+   so bitcode is written once, already optimized.  -n writes nothing,
+   which with -O leaves just the optimizer's counts to look at.
+
+   -r JIT-compiles each program with ORC and runs its main once before
+   and once after optimizing it (so it implies -O), reporting how long
+   it ran each time and, for an int main, what it returned.  Files are
+   then compiled one at a time so that the timings do not disturb each
+   other. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/ExecutionEngine/Orc/ExecutionUtils.h"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/ExecutionEngine/Orc/ThreadSafeModule.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/ToolOutputFile.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "cmm.h"
+#include "../CSE/CSE.h"
+
+using namespace llvm;
+using namespace std;
+
+int verbose=0;
+static bool optimize=false;
+static bool run=false;
+static unsigned opt_threads=1;    /* per module; files are compiled in parallel */
+
+static string output_name(const char *infile)
+{
+  string name = infile;
+  size_t slash = name.find_last_of('/');
+  size_t dot = name.find_last_of('.');
+  if (dot != string::npos && (slash == string::npos || dot > slash))
+    name.erase(dot);
+  return name + ".bc";
+}
+
+static bool jit_error(cmm_context *ctx, Error E)
+{
+  fprintf(stderr,"%s: cannot run main: %s\n",ctx->filename,toString(std::move(E)).c_str());
+  return false;
+}
+
+/* JIT-compile the module as it stands and time one call of its main.
+   The JIT gets a copy in a context of its own, made through bitcode as
+   the optimizer's parallel driver does, so ctx->M can still be optimized
+   afterwards.  Only the call is timed, not the compilation.  *result is
+   only set, and *returned true, when main returns an int; any other main
+   is called for its time alone. */
+static bool run_main(cmm_context *ctx, int64_t *result, bool *returned, double *seconds)
+{
+  Function *F = ctx->M->getFunction("main");
+  if (F==NULL || F->isDeclaration() || F->arg_size()!=0)
+    {
+      fprintf(stderr,"%s: cannot run main: no main() defined\n",ctx->filename);
+      return false;
+    }
+
+  SmallVector<char,0> Bitcode;
+  raw_svector_ostream OS(Bitcode);
+  WriteBitcodeToFile(*ctx->M,OS);
+
+  auto Context = std::make_unique<LLVMContext>();
+  MemoryBufferRef Buffer(StringRef(Bitcode.data(),Bitcode.size()),ctx->filename);
+  Expected<std::unique_ptr<Module>> Copy = parseBitcodeFile(Buffer,*Context);
+  if (!Copy)
+    return jit_error(ctx,Copy.takeError());
+
+  Expected<std::unique_ptr<orc::LLJIT>> JIT = orc::LLJITBuilder().create();
+  if (!JIT)
+    return jit_error(ctx,JIT.takeError());
+
+  /* C-- has no prototypes, so anything it calls but does not define is
+     looked for in this process */
+  auto Process = orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(
+                   (*JIT)->getDataLayout().getGlobalPrefix());
+  if (!Process)
+    return jit_error(ctx,Process.takeError());
+  (*JIT)->getMainJITDylib().addGenerator(std::move(*Process));
+
+  if (Error E = (*JIT)->addIRModule(orc::ThreadSafeModule(std::move(*Copy),std::move(Context))))
+    return jit_error(ctx,std::move(E));
+
+  Expected<JITEvaluatedSymbol> Main = (*JIT)->lookup("main");
+  if (!Main)
+    return jit_error(ctx,Main.takeError());
+  *returned = F->getReturnType()->isIntegerTy(64);
+  auto start = std::chrono::steady_clock::now();
+  if (*returned)
+    *result = jitTargetAddressToFunction<int64_t (*)()>(Main->getAddress())();
+  else
+    jitTargetAddressToFunction<void (*)()>(Main->getAddress())();
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  *seconds = elapsed.count();
+  return true;
+}
+
+/* Compile one file, writing it to outfile unless that is NULL; returns
+   the number of errors */
+static int compile(const char *infile, const char *outfile, CSEStatistics *stats)
+{
+  bool use_stdin = infile==NULL;
+  cmm_context ctx(use_stdin ? "stdin" : infile);
+
+  if (use_stdin)
+    cmm_parse(&ctx,stdin);
+  else
+    cmm_parse_file(&ctx,infile);
+
+  if (ctx.num_errors)
+    return ctx.num_errors;
+
+  if (optimize)
+    {
+      /* the passes take well-formed IR for granted */
+      string problems;
+      raw_string_ostream OS(problems);
+      if (verifyModule(*ctx.M,&OS))
+        {
+          OS.flush();
+          fprintf(stderr,"%s: not optimized, invalid IR:\n%s",ctx.filename,problems.c_str());
+          return 1;
+        }
+
+      int64_t before=0, after=0;
+      bool returned=false;
+      double before_time=0, after_time=0;
+      if (run && !run_main(&ctx,&before,&returned,&before_time))
+        return 1;
+
+      *stats = RunOptimizationPipeline(*ctx.M,opt_threads);
+
+      if (run)
+        {
+          if (!run_main(&ctx,&after,&returned,&after_time))
+            return 1;
+          double speedup = after_time > 0 ? before_time/after_time : 0.0;
+          if (!returned)
+            printf("%s: main ran in %.6fs unoptimized, %.6fs optimized (%.2fx)\n",
+                   ctx.filename,before_time,after_time,speedup);
+          else
+            printf("%s: main returned %lld in %.6fs unoptimized, %lld in %.6fs optimized (%.2fx)\n",
+                   ctx.filename,(long long)before,before_time,(long long)after,after_time,speedup);
+          if (returned && before != after)
+            {
+              fprintf(stderr,"%s: optimizing changed what main returns\n",ctx.filename);
+              return 1;
+            }
+        }
+    }
+
+  if (verbose)
+    {
+      /* one write per file, so that output from other threads does not
+         land in the middle of it */
+      string text;
+      raw_string_ostream OS(text);
+      ctx.M->print(OS,nullptr);
+      verifyModule(*ctx.M,&OS);
+      OS.flush();
+      fputs(text.c_str(),stderr);
+    }
+
+  if (outfile==NULL)
+    return 0;
+
+  std::error_code EC;
+  ToolOutputFile Out(outfile,EC,sys::fs::OF_None);
+  if (EC)
+    {
+      printf("%s: %s\n",outfile,EC.message().c_str());
+      return 1;
+    }
+  WriteBitcodeToFile(*ctx.M,Out.os());
+  Out.keep();
+  return 0;
+}
+
+static void usage()
+{
+  fprintf(stderr,"usage: cmm [-v] [-O] [-r] [-n] [-j threads] [-o output] [file ...]\n");
+  exit(1);
+}
+
+int main(int argc, char **argv)
+{
+  const char *outfile = NULL;
+  bool no_output = false;
+  unsigned jobs = 0;              /* 0: one thread per core */
+  int c;
+
+  while ((c = getopt(argc,argv,"vOrnj:o:")) != -1)
+    switch (c)
+      {
+      case 'v': verbose = 1; break;
+      case 'O': optimize = true; break;
+      case 'r': run = optimize = true; break;
+      case 'n': no_output = true; break;
+      case 'j': jobs = atoi(optarg); break;
+      case 'o': outfile = optarg; break;
+      default: usage();
+      }
+
+  vector<const char*> infiles(argv+optind,argv+argc);
+  if (outfile && (infiles.size() > 1 || no_output))
+    usage();
+
+  if (run)
+    {
+      InitializeNativeTarget();
+      InitializeNativeTargetAsmPrinter();
+    }
+
+  int failed = 0;
+  vector<CSEStatistics> stats(max<size_t>(infiles.size(),1));
+
+  if (infiles.size() <= 1)
+    {
+      /* a lone module gets the threads instead */
+      opt_threads = hardware_concurrency(jobs).compute_thread_count();
+      const char *infile = infiles.empty() ? NULL : infiles[0];
+      string name = outfile ? outfile : infile ? output_name(infile) : "stdin.bc";
+      failed = compile(infile, no_output ? NULL : name.c_str(), &stats[0]);
+    }
+  else
+    {
+      vector<int> errors(infiles.size());
+      {
+        ThreadPool Pool(hardware_concurrency(run ? 1 : jobs));
+        for (size_t i=0; i<infiles.size(); i++)
+          Pool.async([&errors,&infiles,&stats,no_output,i] {
+              string name = output_name(infiles[i]);
+              errors[i] = compile(infiles[i], no_output ? NULL : name.c_str(), &stats[i]);
+            });
+        Pool.wait();
+      }
+
+      for (int e : errors)
+        failed |= e;
+    }
+
+  if (optimize)
+    {
+      for (CSEStatistics &s : stats)
+        CSEStats += s;
+      PrintStatistics(CSEStats);
+      WriteProfile();
+    }
+
+  return failed ? 1 : 0;
+}
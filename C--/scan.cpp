@@ -0,0 +1,342 @@
+/* * * * * * * * * * * * * * * * * * * *\
+|         C-- hand-written scanner       |
+\* * * * * * * * * * * * * * * * * * * */
+
+/* Produces exactly the tokens, values and line numbers the flex rules in
+   cmm.lex do, for a source that is wholly in memory.  Whitespace runs,
+   comments and identifiers are skipped a vector at a time: 32 bytes with
+   AVX2 (built with -mavx2), 16 with SSE2, which every x86-64 has, and a
+   byte at a time anywhere else.
+
+   Used for mapped files when the frontend is built with CMM_SIMD_SCANNER.
+   Building with CMM_VERIFY_SCANNER as well runs flex alongside it and
+   reports the first token on which the two disagree.
+   tests/verify_scanner.sh builds it that way and runs it over the corpus
+   in tests/scanner. */
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <vector>
+
+using namespace std;
+
+#include "cmm.h"
+#include "cmm.y.hpp"
+
+#if defined(__AVX2__)
+
+#define VEC_SIZE 32
+#define VEC_ALL  0xffffffffu
+typedef __m256i vec_t;
+
+static inline vec_t vec_load(const char *p) { return _mm256_loadu_si256((const __m256i*)p); }
+static inline vec_t vec_splat(char c) { return _mm256_set1_epi8(c); }
+static inline vec_t vec_eq(vec_t a, vec_t b) { return _mm256_cmpeq_epi8(a,b); }
+static inline vec_t vec_gt(vec_t a, vec_t b) { return _mm256_cmpgt_epi8(a,b); }
+static inline vec_t vec_and(vec_t a, vec_t b) { return _mm256_and_si256(a,b); }
+static inline vec_t vec_or(vec_t a, vec_t b) { return _mm256_or_si256(a,b); }
+static inline uint32_t vec_mask(vec_t a) { return (uint32_t)_mm256_movemask_epi8(a); }
+
+#elif defined(__SSE2__)
+
+#define VEC_SIZE 16
+#define VEC_ALL  0xffffu
+typedef __m128i vec_t;
+
+static inline vec_t vec_load(const char *p) { return _mm_loadu_si128((const __m128i*)p); }
+static inline vec_t vec_splat(char c) { return _mm_set1_epi8(c); }
+static inline vec_t vec_eq(vec_t a, vec_t b) { return _mm_cmpeq_epi8(a,b); }
+static inline vec_t vec_gt(vec_t a, vec_t b) { return _mm_cmpgt_epi8(a,b); }
+static inline vec_t vec_and(vec_t a, vec_t b) { return _mm_and_si128(a,b); }
+static inline vec_t vec_or(vec_t a, vec_t b) { return _mm_or_si128(a,b); }
+static inline uint32_t vec_mask(vec_t a) { return (uint32_t)_mm_movemask_epi8(a); }
+
+#endif
+
+/* Vectors are only loaded whole from inside the source, never across its
+   end, so a source that ends at the edge of a mapping is safe; the bytes
+   left over are done one at a time. */
+
+static inline bool is_newline(unsigned char c) { return c=='\n' || c=='\r'; }
+static inline bool is_space(unsigned char c) { return c==' ' || c=='\t' || is_newline(c); }
+static inline bool is_digit(unsigned char c) { return (unsigned)(c-'0') < 10; }
+static inline bool is_ident(unsigned char c)
+{
+  return (unsigned)((c|0x20)-'a') < 26 || is_digit(c) || c=='_';
+}
+
+/* {SPACE} and {NEWLINE}: both \n and \r count as a line */
+static const char *skip_space(const char *p, const char *end, int *line)
+{
+#ifdef VEC_SIZE
+  while (end-p >= VEC_SIZE)
+    {
+      vec_t v = vec_load(p);
+      vec_t nl = vec_or(vec_eq(v,vec_splat('\n')), vec_eq(v,vec_splat('\r')));
+      uint32_t newline = vec_mask(nl);
+      uint32_t space = vec_mask(vec_or(nl, vec_or(vec_eq(v,vec_splat(' ')),
+                                                  vec_eq(v,vec_splat('\t')))));
+      if (space != VEC_ALL)
+        {
+          unsigned n = __builtin_ctz(~space);
+          *line += __builtin_popcount(newline & ((1u<<n)-1));
+          return p+n;
+        }
+      *line += __builtin_popcount(newline);
+      p += VEC_SIZE;
+    }
+#endif
+  for (; p<end && is_space(*p); p++)
+    if (is_newline(*p))
+      (*line)++;
+  return p;
+}
+
+/* the rest of [a-zA-Z_0-9]* */
+static const char *skip_ident(const char *p, const char *end)
+{
+#ifdef VEC_SIZE
+  while (end-p >= VEC_SIZE)
+    {
+      vec_t v = vec_load(p);
+      vec_t lower = vec_or(v, vec_splat(0x20));
+      vec_t alpha = vec_and(vec_gt(lower, vec_splat('a'-1)), vec_gt(vec_splat('z'+1), lower));
+      vec_t digit = vec_and(vec_gt(v, vec_splat('0'-1)), vec_gt(vec_splat('9'+1), v));
+      uint32_t ident = vec_mask(vec_or(vec_or(alpha,digit), vec_eq(v,vec_splat('_'))));
+      if (ident != VEC_ALL)
+        return p + __builtin_ctz(~ident);
+      p += VEC_SIZE;
+    }
+#endif
+  while (p<end && is_ident(*p))
+    p++;
+  return p;
+}
+
+/* "//"[^\n]* : up to, not over, the newline */
+static const char *skip_line(const char *p, const char *end)
+{
+#ifdef VEC_SIZE
+  while (end-p >= VEC_SIZE)
+    {
+      uint32_t newline = vec_mask(vec_eq(vec_load(p), vec_splat('\n')));
+      if (newline)
+        return p + __builtin_ctz(newline);
+      p += VEC_SIZE;
+    }
+#endif
+  while (p<end && *p!='\n')
+    p++;
+  return p;
+}
+
+/* The <comment> rules: everything up to and including the first "*" "/".
+   Only \n counts as a line here; [^*\n]* swallows a \r before {NEWLINE}
+   can match it.  An unterminated comment runs to the end of the source. */
+static const char *skip_block(const char *p, const char *end, int *line)
+{
+#ifdef VEC_SIZE
+  /* the slash is looked for one byte on, so a "*" ending one vector is
+     still paired with a "/" starting the next */
+  while (end-p >= VEC_SIZE+1)
+    {
+      vec_t v = vec_load(p);
+      uint32_t close = vec_mask(vec_and(vec_eq(v, vec_splat('*')),
+                                        vec_eq(vec_load(p+1), vec_splat('/'))));
+      uint32_t newline = vec_mask(vec_eq(v, vec_splat('\n')));
+      if (close)
+        {
+          unsigned n = __builtin_ctz(close);
+          *line += __builtin_popcount(newline & ((1u<<n)-1));
+          return p+n+2;
+        }
+      *line += __builtin_popcount(newline);
+      p += VEC_SIZE;
+    }
+#endif
+  for (; p<end; p++)
+    {
+      if (*p=='\n')
+        (*line)++;
+      else if (*p=='*' && p+1<end && p[1]=='/')
+        return p+2;
+    }
+  return end;
+}
+
+static int keyword(const char *s, size_t len)
+{
+  switch (len)
+    {
+    case 2:
+      if (!memcmp(s,"if",2)) return IF;
+      if (!memcmp(s,"do",2)) return DO;
+      break;
+    case 3:
+      if (!memcmp(s,"int",3)) return INT;
+      if (!memcmp(s,"for",3)) return FOR;
+      break;
+    case 4:
+      if (!memcmp(s,"void",4)) return VOID;
+      if (!memcmp(s,"else",4)) return ELSE;
+      if (!memcmp(s,"case",4)) return CASE;
+      if (!memcmp(s,"zext",4)) return ZEXT;
+      if (!memcmp(s,"sext",4)) return SEXT;
+      if (!memcmp(s,"bool",4)) return BOOL;
+      break;
+    case 5:
+      if (!memcmp(s,"while",5)) return WHILE;
+      if (!memcmp(s,"break",5)) return BREAK;
+      break;
+    case 6:
+      if (!memcmp(s,"switch",6)) return SWITCH;
+      if (!memcmp(s,"return",6)) return RETURN;
+      break;
+    case 8:
+      if (!memcmp(s,"inttoptr",8)) return I2P;
+      if (!memcmp(s,"ptrtoint",8)) return P2I;
+      if (!memcmp(s,"continue",8)) return CONTINUE;
+      break;
+    }
+  return ID;
+}
+
+void scan_init(scan_state *scan, const char *text, size_t len, bool shadow)
+{
+  scan->cur = text;
+  scan->end = text+len;
+  scan->line = 1;
+  scan->shadow = shadow;
+}
+
+int scan_token(scan_state *scan, YYSTYPE *lval, cmm_context *ctx)
+{
+  const char *p = scan->cur;
+  const char *end = scan->end;
+  int token;
+
+  for (;;)
+    {
+      if (p<end && is_space(*p))
+        p = skip_space(p,end,&scan->line);
+      if (p==end)
+        {
+          scan->cur = p;
+          return 0;
+        }
+
+      const char *start = p;
+      unsigned char c = *p++;
+      unsigned char next = p<end ? *p : 0;
+
+      if (is_ident(c) && !is_digit(c))
+        {
+          p = skip_ident(p,end);
+          token = keyword(start,p-start);
+          if (token==ID)
+            {
+              lval->id = scan->shadow ? atom_intern(ctx->symtab,start,p-start)
+                                      : atom_intern_span(ctx->symtab,start,p-start);
+              if (lval->id==NULL)
+                {
+                  /* when shadowing flex, flex reports it */
+                  if (!scan->shadow)
+                    {
+                      ctx->line_num = scan->line;
+                      internal_error(ctx,"out of memory interning identifiers");
+                    }
+                  token = YYerror;
+                }
+            }
+          break;
+        }
+
+      if (is_digit(c))
+        {
+          uint64_t value = c-'0';
+          for (; p<end && is_digit(*p); p++)
+            value = value*10 + (*p-'0');
+          lval->inum = (int64_t)value;
+          token = CONSTANT_INTEGER;
+          break;
+        }
+
+      if (c=='/' && next=='/')
+        {
+          p = skip_line(p+1,end);
+          /* "//END" only wins over a comment of the same length */
+          if (p-start==5 && !memcmp(start,"//END",5))
+            {
+              token = MYEOF;
+              break;
+            }
+          continue;
+        }
+
+      if (c=='/' && next=='*')
+        {
+          p = skip_block(p+1,end,&scan->line);
+          continue;
+        }
+
+      token = -1;
+      switch (c)
+        {
+        case ';': token = SEMICOLON; break;
+        case ':': token = COLON; break;
+        case ',': token = COMMA; break;
+        case '{': token = LBRACE; break;
+        case '}': token = RBRACE; break;
+        case '(': token = LPAREN; break;
+        case ')': token = RPAREN; break;
+        case '[': token = LBRACKET; break;
+        case ']': token = RBRACKET; break;
+        case '+': token = PLUS; break;
+        case '-': token = MINUS; break;
+        case '*': token = STAR; break;
+        case '/': token = DIV; break;
+        case '%': token = MOD; break;
+        case '.': token = DOT; break;
+        case '&': token = AMPERSAND; break;
+        case '|': token = BITWISE_OR; break;
+        case '^': token = BITWISE_XOR; break;
+        case '~': token = BITWISE_INVERT; break;
+        case '<':
+          if (next=='=') { p++; token = LTE; }
+          else if (next=='<') { p++; token = LSHIFT; }
+          else token = LT;
+          break;
+        case '>':
+          if (next=='=') { p++; token = GTE; }
+          else if (next=='>') { p++; token = RSHIFT; }
+          else token = GT;
+          break;
+        case '=':
+          if (next=='=') { p++; token = EQ; }
+          else token = ASSIGN;
+          break;
+        case '!':
+          if (next=='=') { p++; token = NEQ; }
+          break;
+        }
+      if (token>=0)
+        break;
+
+      /* when shadowing flex, flex reports it */
+      if (!scan->shadow)
+        {
+          ctx->line_num = scan->line;
+          lexical_error(ctx,"Unmatched character");
+        }
+    }
+
+  scan->cur = p;
+  return token;
+}
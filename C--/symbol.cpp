@@ -1,65 +1,350 @@
+#include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
 #include "symbol.h"
 
-// open source hash table: http://troydhanson.github.io/uthash
-#include "uthash.h"
-
-#include "llvm/IR/Module.h"
+/* Memory is handed out from chunks that are only ever released together.
+   Everything a scope allocates, its own record and its symbols alike,
+   comes from one arena; popping the scope rewinds the arena to where it
+   stood when the scope was pushed, so nothing is freed piecemeal. */
+typedef struct arena_chunk
+{
+  struct arena_chunk *prev;         /* chained from newest to oldest */
+  size_t size;
+  size_t used;
+} arena_chunk_t;
 
-extern Module *M;
+typedef struct arena
+{
+  arena_chunk_t *chunk;             /* chunk being filled */
+  arena_chunk_t *spare;             /* emptied chunks kept for reuse */
+} arena_t;
 
+/* One binding of a name.  Bindings of the same name form a stack through
+   'shadowed'; every binding made since the outermost scope was pushed is
+   also chained newest first through 'undo', which is how a scope finds
+   the bindings it has to take back when it is popped. */
 struct symbol_info {
-  const char         *name;
+  atom_t         *name;
   int          isArg;
   Value        *val;
-  UT_hash_handle  hh; // do not change this name
+  struct symbol_info *shadowed;     /* outer binding of the same name */
+  struct symbol_info *undo;         /* binding made just before this one */
 };
 
+#define ARENA_CHUNK_SIZE (64*1024)
+#define ARENA_ALIGN      alignof(max_align_t)
+#define ARENA_HEADER     ((sizeof(arena_chunk_t) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1))
+
 typedef struct scope_def
 {
   struct scope_def * lower;
-  struct symbol_info * map;
+  struct symbol_info * undo;        /* last binding made before the scope */
+  arena_chunk_t * mark_chunk;       /* the arena when the scope was pushed */
+  size_t mark_used;
 } scope_t;
 
-scope_t *head=NULL;
+/* Every name bound in any open scope, in one open-addressed table keyed by
+   atom and kept at most half full.  A slot holds the innermost binding of
+   its name, so finding a symbol is a single probe however deep the
+   nesting.  Slots are never vacated: popping a scope only exposes the
+   shadowed binding, possibly NULL, and the slot is reused when the name
+   is bound again. */
+typedef struct binding_slot
+{
+  atom_t *name;
+  struct symbol_info *top;
+} binding_slot_t;
+
+struct symtab
+{
+  Module *module;                   /* where globals are looked up */
+  scope_t *head;
+
+  binding_slot_t *bindings;
+  unsigned binding_count;
+  unsigned binding_capacity;
+  struct symbol_info *undo_log;     /* newest binding made */
+
+  /* open-addressed table of every atom, kept at most half full */
+  atom_t **atoms;
+  unsigned atom_count;
+  unsigned atom_capacity;
+
+  arena_t scope_arena;              /* rewound as scopes are popped */
+  arena_t atom_arena;               /* atoms live as long as the table */
+};
 
-void symbol_push_scope()
+static void *arena_alloc(arena_t *arena, size_t size)
 {
-  scope_t *new_scope = (scope_t*) malloc (sizeof(scope_t));
-  new_scope->lower = head;
-  new_scope->map = NULL;
-  head = new_scope;
+  size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+
+  arena_chunk_t *chunk = arena->chunk;
+  if (chunk==NULL || chunk->used + size > chunk->size)
+    {
+      if (arena->spare && size <= arena->spare->size)
+        {
+          chunk = arena->spare;
+          arena->spare = chunk->prev;
+        }
+      else
+        {
+          size_t bytes = size > ARENA_CHUNK_SIZE ? size : ARENA_CHUNK_SIZE;
+          chunk = (arena_chunk_t*) malloc(ARENA_HEADER + bytes);
+          if (chunk==NULL)
+            return NULL;
+          chunk->size = bytes;
+        }
+      chunk->prev = arena->chunk;
+      chunk->used = 0;
+      arena->chunk = chunk;
+    }
+
+  void *p = (char*)chunk + ARENA_HEADER + chunk->used;
+  chunk->used += size;
+  return p;
+}
+
+static void arena_release(arena_t *arena, arena_chunk_t *mark_chunk, size_t mark_used)
+{
+  while (arena->chunk != mark_chunk)
+    {
+      arena_chunk_t *chunk = arena->chunk;
+      arena->chunk = chunk->prev;
+
+      // chunks made for one large request are not worth keeping
+      if (chunk->size == ARENA_CHUNK_SIZE)
+        {
+          chunk->prev = arena->spare;
+          arena->spare = chunk;
+        }
+      else
+        free(chunk);
+    }
+
+  if (arena->chunk)
+    arena->chunk->used = mark_used;
 }
 
-void symbol_pop_scope()
+static void arena_destroy(arena_t *arena)
 {
-  scope_t *old = head;
-  head = head->lower;
-  free(old);
+  arena_release(arena, NULL, 0);
+  while (arena->spare)
+    {
+      arena_chunk_t *chunk = arena->spare;
+      arena->spare = chunk->prev;
+      free(chunk);
+    }
 }
 
-int is_global_scope()
+symtab_t* symtab_create(Module *module)
 {
-  return head==NULL;
+  symtab_t *symtab = (symtab_t*) calloc(1, sizeof(symtab_t));
+  if (symtab==NULL)
+    return NULL;
+  symtab->module = module;
+  return symtab;
 }
 
-void symbol_insert(const char* name, Value* val)
+void symtab_destroy(symtab_t *symtab)
 {
-  if (head==NULL)
+  if (symtab==NULL)
     return;
 
-  struct symbol_info *si = (struct symbol_info*) malloc(sizeof(struct symbol_info));
+  arena_destroy(&symtab->scope_arena);
+  arena_destroy(&symtab->atom_arena);
+  free(symtab->bindings);
+  free(symtab->atoms);
+  free(symtab);
+}
+
+static unsigned atom_hash(const char *text, size_t len)
+{
+  // FNV-1a
+  unsigned hash = 2166136261u;
+  for (size_t i=0; i<len; i++)
+    {
+      hash ^= (unsigned char)text[i];
+      hash *= 16777619u;
+    }
+  return hash;
+}
+
+static bool atom_grow(symtab_t *symtab)
+{
+  unsigned capacity = symtab->atom_capacity ? 2*symtab->atom_capacity : 1024;
+  atom_t **table = (atom_t**) calloc(capacity, sizeof(atom_t*));
+  if (table==NULL)
+    return false;
+
+  for (unsigned i=0; i<symtab->atom_capacity; i++)
+    if (symtab->atoms[i])
+      {
+        unsigned j = symtab->atoms[i]->hash & (capacity-1);
+        while (table[j])
+          j = (j+1) & (capacity-1);
+        table[j] = symtab->atoms[i];
+      }
+
+  free(symtab->atoms);
+  symtab->atoms = table;
+  symtab->atom_capacity = capacity;
+  return true;
+}
+
+static atom_t* atom_lookup(symtab_t *symtab, const char* text, size_t len, bool copy)
+{
+  if (2*(symtab->atom_count+1) > symtab->atom_capacity && !atom_grow(symtab))
+    return NULL;
+
+  atom_t **atoms = symtab->atoms;
+  unsigned mask = symtab->atom_capacity-1;
+  unsigned hash = atom_hash(text,len);
+  unsigned i = hash & mask;
+  for (; atoms[i]; i = (i+1) & mask)
+    if (atoms[i]->hash==hash && atoms[i]->len==len && memcmp(atoms[i]->name,text,len)==0)
+      return atoms[i];
+
+  atom_t *a = (atom_t*) arena_alloc(&symtab->atom_arena, sizeof(atom_t) + (copy ? len+1 : 0));
+  if (a==NULL)
+    return NULL;
+  if (copy)
+    {
+      char *name = (char*)(a+1);
+      memcpy(name,text,len);
+      name[len] = 0;
+      text = name;
+    }
+
+  a->name = text;
+  a->len = len;
+  a->hash = hash;
+  a->global = NULL;
+  atoms[i] = a;
+  symtab->atom_count++;
+  return a;
+}
+
+atom_t* atom_intern(symtab_t *symtab, const char* text, size_t len)
+{
+  return atom_lookup(symtab,text,len,true);
+}
+
+atom_t* atom_intern_span(symtab_t *symtab, const char* text, size_t len)
+{
+  return atom_lookup(symtab,text,len,false);
+}
+
+static bool binding_grow(symtab_t *symtab)
+{
+  unsigned capacity = symtab->binding_capacity ? 2*symtab->binding_capacity : 256;
+  binding_slot_t *table = (binding_slot_t*) calloc(capacity, sizeof(binding_slot_t));
+  if (table==NULL)
+    return false;
+
+  for (unsigned i=0; i<symtab->binding_capacity; i++)
+    if (symtab->bindings[i].name)
+      {
+        unsigned j = symtab->bindings[i].name->hash & (capacity-1);
+        while (table[j].name)
+          j = (j+1) & (capacity-1);
+        table[j] = symtab->bindings[i];
+      }
+
+  free(symtab->bindings);
+  symtab->bindings = table;
+  symtab->binding_capacity = capacity;
+  return true;
+}
+
+/* The slot for name, or the empty slot it would go in */
+static binding_slot_t* binding_slot(symtab_t *symtab, atom_t *name)
+{
+  unsigned mask = symtab->binding_capacity-1;
+  unsigned i = name->hash & mask;
+  while (symtab->bindings[i].name && symtab->bindings[i].name != name)
+    i = (i+1) & mask;
+  return &symtab->bindings[i];
+}
+
+int symbol_push_scope(symtab_t *symtab)
+{
+  arena_chunk_t *mark_chunk = symtab->scope_arena.chunk;
+  size_t mark_used = mark_chunk ? mark_chunk->used : 0;
+
+  scope_t *new_scope = (scope_t*) arena_alloc (&symtab->scope_arena, sizeof(scope_t));
+  if (new_scope==NULL)
+    return 1;
+  new_scope->lower = symtab->head;
+  new_scope->undo = symtab->undo_log;
+  new_scope->mark_chunk = mark_chunk;
+  new_scope->mark_used = mark_used;
+  symtab->head = new_scope;
+  return 0;
+}
+
+void symbol_pop_scope(symtab_t *symtab)
+{
+  scope_t *old = symtab->head;
+  symtab->head = old->lower;
+
+  /* take back the scope's bindings, newest first */
+  for (struct symbol_info *si = symtab->undo_log; si != old->undo; si = si->undo)
+    binding_slot(symtab,si->name)->top = si->shadowed;
+  symtab->undo_log = old->undo;
+
+  arena_release(&symtab->scope_arena, old->mark_chunk, old->mark_used);
+}
+
+int is_global_scope(symtab_t *symtab)
+{
+  return symtab->head==NULL;
+}
+
+int symbol_insert(symtab_t *symtab, atom_t* name, Value* val)
+{
+  if (symtab->head==NULL)
+    return 0;
+
+  if ((symtab->bindings==NULL || 2*(symtab->binding_count+1) > symtab->binding_capacity) &&
+      !binding_grow(symtab))
+    return 1;
+
+  struct symbol_info *si = (struct symbol_info*) arena_alloc(&symtab->scope_arena, sizeof(struct symbol_info));
+  if (si==NULL)
+    return 1;
+
+  binding_slot_t *slot = binding_slot(symtab,name);
+  if (slot->name==NULL)
+    {
+      slot->name = name;
+      symtab->binding_count++;
+    }
+
   si->name = name;
+  si->isArg = 0;
   si->val = val;
+  si->shadowed = slot->top;
+  si->undo = symtab->undo_log;
 
-  HASH_ADD_KEYPTR( hh, head->map, name, strlen(name), si );
+  slot->top = si;
+  symtab->undo_log = si;
+  return 0;
 }
 
-struct symbol_info * get_symbol_in_scope(const char* name, scope_t *scope);
+/* Globals are never removed, so once found one stays valid for the
+   life of the module */
+static GlobalValue* atom_global(symtab_t *symtab, atom_t *name)
+{
+  if (name->global == NULL)
+    name->global = symtab->module->getNamedValue(StringRef(name->name,name->len));
+  return name->global;
+}
 
-Value* symbol_find(const char*name)
+Value* symbol_find(symtab_t *symtab, atom_t *name)
 {
-  struct symbol_info *si = get_symbol_in_scope(name,head);
+  struct symbol_info *si = symtab->bindings ? binding_slot(symtab,name)->top : NULL;
 
   if (si)
     {
@@ -67,25 +352,11 @@ Value* symbol_find(const char*name)
     }
   else
     {
-      return M->getNamedGlobal(name);
+      return dyn_cast_or_null<GlobalVariable>(atom_global(symtab,name));
     }
 }
 
-struct symbol_info * get_symbol_in_scope(const char *name, scope_t *scope)
+Function* symbol_find_function(symtab_t *symtab, atom_t *name)
 {
-  if (scope==NULL)
-    {
-      /* then must be global scope */
-      return NULL;
-    }
-
-  struct symbol_info *si;
-
-  HASH_FIND_STR(scope->map, name, si);  /* id already in the hash? */
-  if (si==NULL) {
-    scope = scope->lower;
-    return get_symbol_in_scope(name,scope);
-  }
-
-  return si;
+  return dyn_cast_or_null<Function>(atom_global(symtab,name));
 }
@@ -2,15 +2,53 @@
 #define SYMBOL_H
 
 #include "llvm/IR/Value.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalVariable.h"
 
 using namespace llvm;
 
-void symbol_push_scope();
-void symbol_pop_scope();
+/* An interned identifier: the lexer returns the same atom for every
+   occurrence of a name, so names compare by pointer and are hashed once.
+   The name is not NUL-terminated when the atom was interned from a span
+   of the source; use atom_name() to get at it. */
+typedef struct atom
+{
+  const char *name;
+  unsigned len;
+  unsigned hash;
+  GlobalValue *global;   /* the module's global of this name, once found */
+} atom_t;
 
-int is_global_scope();
+static inline StringRef atom_name(const atom_t *atom)
+{
+  return StringRef(atom->name, atom->len);
+}
 
-void symbol_insert(const char* name, Value* val);
-Value* symbol_find(const char*);
+/* The atoms and scopes of one compilation, tied to the module it builds.
+   Nothing is shared between symbol tables, so each may be used from its
+   own thread. */
+typedef struct symtab symtab_t;
+
+/* Every call that allocates fails softly: symtab_create and the atom
+   functions return NULL and the scope functions nonzero when out of
+   memory, and leave it to the caller to report the error against its
+   compilation rather than ending the process. */
+symtab_t* symtab_create(Module *module);
+void symtab_destroy(symtab_t *symtab);
+
+atom_t* atom_intern(symtab_t *symtab, const char* text, size_t len);
+/* As atom_intern, but a new atom refers to text in place instead of
+   copying it, so text must outlive the symbol table */
+atom_t* atom_intern_span(symtab_t *symtab, const char* text, size_t len);
+
+int symbol_push_scope(symtab_t *symtab);
+void symbol_pop_scope(symtab_t *symtab);
+
+int is_global_scope(symtab_t *symtab);
+
+int symbol_insert(symtab_t *symtab, atom_t* name, Value* val);
+Value* symbol_find(symtab_t *symtab, atom_t*);
+Function* symbol_find_function(symtab_t *symtab, atom_t*);
 
 #endif
@@ -0,0 +1,248 @@
+/* Runs of every length around the 16 and 32 byte vectors the scanner
+   skips identifiers, spaces and comments with, and around 64 */
+int main()
+{
+  int v14_abcdefghij;
+  int v15_abcdefghijk;
+  int v16_abcdefghijkl;
+  int v17_abcdefghijklm;
+  int v18_abcdefghijklmn;
+  int v30_abcdefghijklmnopqrstuvwxyz;
+  int v31_abcdefghijklmnopqrstuvwxyzA;
+  int v32_abcdefghijklmnopqrstuvwxyzAB;
+  int v33_abcdefghijklmnopqrstuvwxyzABC;
+  int v34_abcdefghijklmnopqrstuvwxyzABCD;
+  int v46_abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOP;
+  int v47_abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQ;
+  int v48_abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQR;
+  int v49_abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRS;
+  int v50_abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRST;
+  int v62_abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ_01234;
+  int v63_abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ_012345;
+  int v64_abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ_0123456;
+  int v65_abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ_01234567;
+  int v66_abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ_012345678;
+  v14_abcdefghij = 	 	 	 	 	 	 	14;
+  v15_abcdefghijk = 	 	 	 	 	 	 	 15;
+  v16_abcdefghijkl = 	 	 	 	 	 	 	 	16;
+  v17_abcdefghijklm = 	 	 	 	 	 	 	 	 17;
+  v18_abcdefghijklmn = 	 	 	 	 	 	 	 	 	18;
+  v30_abcdefghijklmnopqrstuvwxyz = 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	30;
+  v31_abcdefghijklmnopqrstuvwxyzA = 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 31;
+  v32_abcdefghijklmnopqrstuvwxyzAB = 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	32;
+  v33_abcdefghijklmnopqrstuvwxyzABC = 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 33;
+  v34_abcdefghijklmnopqrstuvwxyzABCD = 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	34;
+  v46_abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOP = 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	46;
+  v47_abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQ = 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 47;
+  v48_abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQR = 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	48;
+  v49_abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRS = 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 49;
+  v50_abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRST = 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	50;
+  v62_abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ_01234 = 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	62;
+  v63_abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ_012345 = 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 63;
+  v64_abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ_0123456 = 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	64;
+  v65_abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ_01234567 = 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 65;
+  v66_abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ_012345678 = 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	 	66;
+  /*xxxxxxxxxx*/v14_abcdefghij = v14_abcdefghij + 1;
+  /*************/
+  //yyyyyyyyyyyy
+  /*
+
+
+
+
+              
+*/
+  /*xxxxxxxxxxx*/v14_abcdefghij = v14_abcdefghij + 1;
+  /**************/
+  //yyyyyyyyyyyyy
+  /*
+               
+*/
+  /*xxxxxxxxxxxx*/v14_abcdefghij = v14_abcdefghij + 1;
+  /***************/
+  //yyyyyyyyyyyyyy
+  /*
+
+                
+*/
+  /*xxxxxxxxxxxxx*/v14_abcdefghij = v14_abcdefghij + 1;
+  /****************/
+  //yyyyyyyyyyyyyyy
+  /*
+
+
+                 
+*/
+  /*xxxxxxxxxxxxxx*/v14_abcdefghij = v14_abcdefghij + 1;
+  /*****************/
+  //yyyyyyyyyyyyyyyy
+  /*
+
+
+
+                  
+*/
+  /*xxxxxxxxxxxxxxxxxxxxxxxxxx*/v14_abcdefghij = v14_abcdefghij + 1;
+  /*****************************/
+  //yyyyyyyyyyyyyyyyyyyyyyyyyyyy
+  /*
+                              
+*/
+  /*xxxxxxxxxxxxxxxxxxxxxxxxxxx*/v14_abcdefghij = v14_abcdefghij + 1;
+  /******************************/
+  //yyyyyyyyyyyyyyyyyyyyyyyyyyyyy
+  /*
+
+                               
+*/
+  /*xxxxxxxxxxxxxxxxxxxxxxxxxxxx*/v14_abcdefghij = v14_abcdefghij + 1;
+  /*******************************/
+  //yyyyyyyyyyyyyyyyyyyyyyyyyyyyyy
+  /*
+
+
+                                
+*/
+  /*xxxxxxxxxxxxxxxxxxxxxxxxxxxxx*/v14_abcdefghij = v14_abcdefghij + 1;
+  /********************************/
+  //yyyyyyyyyyyyyyyyyyyyyyyyyyyyyyy
+  /*
+
+
+
+                                 
+*/
+  /*xxxxxxxxxxxxxxxxxxxxxxxxxxxxxx*/v14_abcdefghij = v14_abcdefghij + 1;
+  /*********************************/
+  //yyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyy
+  /*
+
+
+
+
+                                  
+*/
+  /*xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx*/v14_abcdefghij = v14_abcdefghij + 1;
+  /*********************************************/
+  //yyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyy
+  /*
+
+                                              
+*/
+  /*xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx*/v14_abcdefghij = v14_abcdefghij + 1;
+  /**********************************************/
+  //yyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyy
+  /*
+
+
+                                               
+*/
+  /*xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx*/v14_abcdefghij = v14_abcdefghij + 1;
+  /***********************************************/
+  //yyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyy
+  /*
+
+
+
+                                                
+*/
+  /*xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx*/v14_abcdefghij = v14_abcdefghij + 1;
+  /************************************************/
+  //yyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyy
+  /*
+
+
+
+
+                                                 
+*/
+  /*xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx*/v14_abcdefghij = v14_abcdefghij + 1;
+  /*************************************************/
+  //yyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyy
+  /*
+                                                  
+*/
+  /*xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx*/v14_abcdefghij = v14_abcdefghij + 1;
+  /*************************************************************/
+  //yyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyy
+  /*
+
+
+                                                              
+*/
+  /*xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx*/v14_abcdefghij = v14_abcdefghij + 1;
+  /**************************************************************/
+  //yyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyy
+  /*
+
+
+
+                                                               
+*/
+  /*xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx*/v14_abcdefghij = v14_abcdefghij + 1;
+  /***************************************************************/
+  //yyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyy
+  /*
+
+
+
+
+                                                                
+*/
+  /*xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx*/v14_abcdefghij = v14_abcdefghij + 1;
+  /****************************************************************/
+  //yyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyy
+  /*
+                                                                 
+*/
+  /*xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx*/v14_abcdefghij = v14_abcdefghij + 1;
+  /*****************************************************************/
+  //yyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyyy
+  /*
+
+                                                                  
+*/
+  v14_abcdefghij = 11111111111111;
+  v14_abcdefghij = 111111111111111;
+  v14_abcdefghij = 1111111111111111;
+  v14_abcdefghij = 11111111111111111;
+  v14_abcdefghij = 111111111111111111;
+  v14_abcdefghij = 111111111111111111;
+  v14_abcdefghij = 111111111111111111;
+  v14_abcdefghij = 111111111111111111;
+  v14_abcdefghij = 111111111111111111;
+  v14_abcdefghij = 111111111111111111;
+  v14_abcdefghij = 111111111111111111;
+  v14_abcdefghij = 111111111111111111;
+  v14_abcdefghij = 111111111111111111;
+  v14_abcdefghij = 111111111111111111;
+  v14_abcdefghij = 111111111111111111;
+  v14_abcdefghij = 111111111111111111;
+  v14_abcdefghij = 111111111111111111;
+  v14_abcdefghij = 111111111111111111;
+  v14_abcdefghij = 111111111111111111;
+  v14_abcdefghij = 111111111111111111;
+  return v14_abcdefghij + v15_abcdefghijk + v16_abcdefghijkl + v17_abcdefghijklm + v18_abcdefghijklmn + v30_abcdefghijklmnopqrstuvwxyz + v31_abcdefghijklmnopqrstuvwxyzA + v32_abcdefghijklmnopqrstuvwxyzAB + v33_abcdefghijklmnopqrstuvwxyzABC + v34_abcdefghijklmnopqrstuvwxyzABCD + v46_abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOP + v47_abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQ + v48_abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQR + v49_abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRS + v50_abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRST + v62_abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ_01234 + v63_abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ_012345 + v64_abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ_0123456 + v65_abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ_01234567 + v66_abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ_012345678;
+}
+ 	
+ 	
+ 	
+ 	
+ 	
+ 	
+ 	
+ 	
+ 	
+ 	
+ 	
+ 	
+ 	
+ 	
+ 	
+ 	
+ 	
+ 	
+ 	
+ 	
+ 	
+ 	
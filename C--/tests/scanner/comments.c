@@ -0,0 +1,17 @@
+/*/ is an opening only: the slash after the star does not close it */
+int main()
+{
+  int a;
+  int b;
+  /**/
+  /***/
+  /* a * / b is not a close */
+  /* /* comments do not nest */
+  /* stars run into the close **/
+  a = 84;
+  b = a / 2; /* a lone slash is division */
+  b = b/ 1;
+  return b;
+}
+/* this comment never ends, so it runs to the end of the file
+   int main() { return 0; }
@@ -0,0 +1,25 @@
+/* Every line of this file ends in CR LF.  Outside comments flex counts
+   the CR and the LF as a line each; inside one only the LF counts. */
+int total;
+
+int add(int a, int b)
+{
+  int sum;
+  // a line comment keeps its CR: [^\n]* runs up to the LF
+  sum = a + b;
+  //END
+  // that was a comment six bytes long, not the end marker
+  return sum;
+}
+
+int main()
+{
+  int i;
+  int n;
+  n = 0;
+  for (i = 0; i < 10; i = i + 1)
+    n = add(n, i);
+  /* a block comment
+     over two lines */
+  return n;
+}
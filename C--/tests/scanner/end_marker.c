@@ -0,0 +1,19 @@
+/* "//END" is only the end marker when nothing else is on its line;
+   otherwise "//"[^\n]* is the longer match and it is a comment. */
+int twice(int x)
+{
+  //END x
+  //ENDx
+  //EN
+  // //END
+  return x + x;
+}
+
+int main()
+{
+  int y;
+  y = twice(21); //END of statement
+  return y;
+}
+//END
+Nothing past the marker is scanned: @ # $ ` and an unterminated /*
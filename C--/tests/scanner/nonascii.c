@@ -0,0 +1,12 @@
+/* Bytes outside ASCII: each is an unmatched character outside a
+   comment and harmless inside one: café, über, 日本 */
+int main()
+{
+  int caf;
+  int e;
+  // ééé in a line comment
+  caf = 1;é e = 2;
+  e = caf+ e;
+  e = e  + 1;
+  return caf​+ e;
+}
@@ -0,0 +1,70 @@
+#!/bin/sh
+# Checks the hand-written scanner (scan.cpp) against the flex rules in
+# cmm.lex.  The frontend is built with CMM_VERIFY_SCANNER, which runs
+# both on every mapped source and reports the first token, value or line
+# number on which they disagree, and then every file in tests/scanner is
+# compiled with it.  It is built once for 16-byte vectors and, where the
+# machine has AVX2, once more for 32-byte ones.
+#
+#   usage: tests/verify_scanner.sh [file.c ...]
+#
+# Needs flex, bison and llvm-config (or LLVM_CONFIG) on the path.  The
+# corpus files have lexical errors of their own on purpose; only a
+# disagreement between the scanners fails the check.
+
+set -e
+
+cd "$(dirname "$0")/.."
+LLVM_CONFIG=${LLVM_CONFIG:-llvm-config}
+CXX=${CXX:-g++}
+
+if [ $# -eq 0 ]; then
+  set -- tests/scanner/*.c
+fi
+
+build=$(mktemp -d)
+trap 'rm -rf "$build"' EXIT
+
+FLAGS="-O1 -std=c++17 -DCMM_VERIFY_SCANNER -I$build -I.
+       -isystem $($LLVM_CONFIG --includedir)
+       $($LLVM_CONFIG --cxxflags | tr ' ' '\n' | grep '^-D' | tr '\n' ' ')"
+LIBS="$($LLVM_CONFIG --ldflags --libs --system-libs)"
+
+bison -d -o "$build/cmm.y.cpp" cmm.y
+flex -o "$build/cmm.lex.cpp" cmm.lex
+
+# the optimizer does not depend on the scanner, so it is built once
+for src in ../CSE/*.cpp; do
+  $CXX $FLAGS -c -o "$build/$(basename "$src" .cpp).o" "$src"
+done
+
+variants="sse2"
+if grep -qw avx2 /proc/cpuinfo 2>/dev/null; then
+  variants="$variants avx2"
+else
+  echo "note: no AVX2 here, 32-byte vectors not checked"
+fi
+
+status=0
+for variant in $variants; do
+  arch=""
+  [ "$variant" = avx2 ] && arch="-mavx2"
+
+  $CXX $FLAGS $arch -o "$build/cmm-$variant" \
+    "$build/cmm.y.cpp" "$build/cmm.lex.cpp" scan.cpp symbol.cpp driver.cpp \
+    "$build"/*.o $LIBS
+
+  for file in "$@"; do
+    rc=0
+    out=$("$build/cmm-$variant" -n -j 1 "$file" 2>&1) || rc=$?
+    if [ $rc -gt 128 ] || echo "$out" | grep -q "disagrees with flex"; then
+      echo "$out"
+      echo "FAIL ($variant): $file"
+      status=1
+    else
+      echo "ok   ($variant): $file"
+    fi
+  done
+done
+
+exit $status
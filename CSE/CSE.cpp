@@ -9,7 +9,8 @@
  *   This file will visit each instruction, check if it's dead or
  *   can be simplified via constant folding, and use common
  *   subexpression elimination to eliminate instructions with the same opcode,
- *   type, or number of operands.
+ *   type, or operands.  Common subexpressions are found by value numbering
+ *   over a preorder walk of the dominator tree.
  */
 
 /* LLVM Header Files */
@@ -19,6 +20,7 @@
 #include "llvm/IR/Function.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/CFG.h"
 #include "llvm/IR/GlobalVariable.h"
 #include "llvm/IR/Type.h"
 #include "llvm/Analysis/AliasAnalysis.h"
@@ -28,8 +30,20 @@
 #include "llvm/IR/ValueMap.h"
 #include "llvm/Support/GraphWriter.h"
 #include "llvm/IR/InstIterator.h"
+#include "llvm/Support/DivisionByConstantInfo.h"
+#include "llvm/Support/Threading.h"
+#include "llvm/ADT/APInt.h"
+#include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/Hashing.h"
+#include "llvm/ADT/ScopedHashTable.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/STLExtras.h"
+#include <cstdlib>
 #include <iostream>
+#include <algorithm>
 #include <map>
+#include <memory>
+#include <vector>
 #include "dominance.h"
 
 using namespace llvm;
@@ -48,91 +62,643 @@ using namespace llvm;
 #include "llvm/PassRegistry.h"
 #include "llvm/IR/IRBuilder.h"
 
-int CSEDead=0;
-int CSEElim=0;
-int CSESimplify=0;
-int CSELdElim=0;
-int CSELdStElim=0;
-int CSERStElim=0;
+thread_local CSEStatistics CSEStats;
 
-void LLVMCommonSubexpressionElimination_Cpp(Module *M)
+CSEStatistics &CSEStatistics::operator+=(const CSEStatistics &O)
+{
+  Dead += O.Dead;
+  Elim += O.Elim;
+  Simplify += O.Simplify;
+  LdElim += O.LdElim;
+  LdStElim += O.LdStElim;
+  RStElim += O.RStElim;
+  Unreach += O.Unreach;
+  Strength += O.Strength;
+  Promoted += O.Promoted;
+  Licm += O.Licm;
+  IndVars += O.IndVars;
+  CacheHits += O.CacheHits;
+  CacheMisses += O.CacheMisses;
+  Profile.insert(Profile.end(), O.Profile.begin(), O.Profile.end());
+  return *this;
+}
+
+static void _RunPipeline(Module &M)
+{
+  RunDeadCodeElimination(M);
+  RunPromoteMemoryToRegister(M);
+  RunConstantFolding(M);
+  RunPeepholeSimplification(M);
+  RunSparseConditionalConstantPropagation(M);
+  RunLoopInvariantCodeMotion(M);
+  RunLoopStrengthReduction(M);
+  RunCommonSubExpressionElimination(M);
+  RunRedundantLoadElimination(M);
+  RunDeadStoreElimination(M);
+  RunDeadCodeElimination(M);
+}
+
+static unsigned _OptimizationThreads()
+{
+  // CSE_THREADS=1 forces the serial path, which is handy when debugging
+  if (const char *Env = getenv("CSE_THREADS"))
+    return std::max(atoi(Env), 1);
+  return hardware_concurrency().compute_thread_count();
+}
+
+CSEStatistics RunOptimizationPipeline(Module &M, unsigned Threads)
 {
-  // for each function, f:
-  //   FunctionCSE(f);
-  RunDeadCodeElimination(*M);
-  RunConstantFolding(*M);
-  RunCommonSubExpressionElimination(*M);
+  // the caller's thread may have counted other modules before this one
+  CSEStatistics Saved = CSEStats;
+  CSEStats = CSEStatistics();
 
+  // CSE_CACHE names a directory of previously optimized functions
+  const char *Cache = getenv("CSE_CACHE");
+  if (Cache == nullptr || !RunPipelineWithCache(M, Cache, Threads, _RunPipeline)) {
+    if (Threads > 1)
+      RunPipelineInParallel(M, Threads, _RunPipeline);
+    else
+      _RunPipeline(M);
+  }
+  LLVMClearDominanceCache();
+
+  CSEStatistics Stats = CSEStats;
+  CSEStats = Saved;
+  return Stats;
+}
+
+void PrintStatistics(const CSEStatistics &Stats)
+{
   // print out summary of results
-  fprintf(stderr,"CSE_Dead.....%d\n", CSEDead);
-  fprintf(stderr,"CSE_Basic.....%d\n", CSEElim);
-  fprintf(stderr,"CSE_Simplify..%d\n", CSESimplify);
-  fprintf(stderr,"CSE_RLd.......%d\n", CSELdElim);
-  fprintf(stderr,"CSE_RSt.......%d\n", CSERStElim);
-  fprintf(stderr,"CSE_LdSt......%d\n", CSELdStElim);
-}
-
-
-bool _AreInstructionsLiteralMatches(llvm::Instruction  &i, llvm::Instruction  &j) {
-  //check if i is not needed to simplify
-  if (isa<VAArgInst>(i) ||
-      isa<FCmpInst>(i) ||
-      isa<AllocaInst>(i) ||
-      isa<CallInst>(i) ||
-      isa<LoadInst>(i) ||
-      isa<StoreInst>(i) ||
-      isa<BranchInst>(i) ||
-      i.isTerminator()) {
-        return false;
+  fprintf(stderr,"CSE_Dead.....%d\n", Stats.Dead);
+  fprintf(stderr,"CSE_Basic.....%d\n", Stats.Elim);
+  fprintf(stderr,"CSE_Simplify..%d\n", Stats.Simplify);
+  fprintf(stderr,"CSE_RLd.......%d\n", Stats.LdElim);
+  fprintf(stderr,"CSE_RSt.......%d\n", Stats.RStElim);
+  fprintf(stderr,"CSE_LdSt......%d\n", Stats.LdStElim);
+  fprintf(stderr,"CSE_Unreach...%d\n", Stats.Unreach);
+  fprintf(stderr,"CSE_Strength..%d\n", Stats.Strength);
+  fprintf(stderr,"CSE_Mem2Reg...%d\n", Stats.Promoted);
+  fprintf(stderr,"CSE_Licm......%d\n", Stats.Licm);
+  fprintf(stderr,"CSE_IndVar....%d\n", Stats.IndVars);
+  if (getenv("CSE_CACHE") != nullptr)
+    fprintf(stderr,"CSE_Cache.....%d/%d\n", Stats.CacheHits,
+            Stats.CacheHits + Stats.CacheMisses);
+}
+
+void LLVMCommonSubexpressionElimination_Cpp(Module *M)
+{
+  CSEStats += RunOptimizationPipeline(*M, _OptimizationThreads());
+  PrintStatistics(CSEStats);
+  WriteProfile();
+}
+
+void LLVMCommonSubexpressionElimination(LLVMModuleRef Module)
+{
+  LLVMCommonSubexpressionElimination_Cpp(unwrap(Module));
+}
+
+
+/*
+ * Value numbering
+ *
+ *   Every pure instruction is reduced to an Expression: its opcode, result
+ *   type, predicate and the value numbers of its operands.  Expressions
+ *   live in a scoped hash table that is pushed and popped as we walk the
+ *   dominator tree in preorder, so an entry is visible exactly in the
+ *   blocks dominated by its definition.  A hit means an earlier, dominating
+ *   instruction already computes the same value.
+ */
+namespace {
+
+struct Expression {
+  unsigned Opcode;
+  Type *Ty;
+  unsigned Predicate;           // CmpInst predicate, 0 otherwise
+  Type *SourceTy;               // GEP source element type, null otherwise
+  SmallVector<unsigned, 4> Ops; // operand value numbers
+};
+
+struct ExpressionInfo {
+  static Expression getEmptyKey() { return {~0U, nullptr, 0, nullptr, {}}; }
+  static Expression getTombstoneKey() { return {~1U, nullptr, 0, nullptr, {}}; }
+  static unsigned getHashValue(const Expression &E) {
+    return (unsigned) hash_combine(E.Opcode, E.Ty, E.Predicate, E.SourceTy,
+                                   hash_combine_range(E.Ops.begin(), E.Ops.end()));
+  }
+  static bool isEqual(const Expression &L, const Expression &R) {
+    return L.Opcode == R.Opcode && L.Ty == R.Ty && L.Predicate == R.Predicate &&
+           L.SourceTy == R.SourceTy && L.Ops == R.Ops;
+  }
+};
+
+typedef ScopedHashTable<Expression, Instruction*, ExpressionInfo> ExpressionTable;
+typedef ScopedHashTableScope<Expression, Instruction*, ExpressionInfo> ExpressionScope;
+
+class ValueNumbering {
+public:
+  unsigned lookupOrAdd(Value *V) {
+    auto It = Numbers.insert(std::make_pair(V, Next));
+    if (It.second)
+      Next++;
+    return It.first->second;
+  }
+
+  Expression createExpression(Instruction &I) {
+    Expression E = {I.getOpcode(), I.getType(), 0, nullptr, {}};
+    for (Value *Op : I.operands())
+      E.Ops.push_back(lookupOrAdd(Op));
+
+    if (CmpInst *CI = dyn_cast<CmpInst>(&I)) {
+      CmpInst::Predicate P = CI->getPredicate();
+      if (E.Ops[0] > E.Ops[1]) {
+        std::swap(E.Ops[0], E.Ops[1]);
+        P = CI->getSwappedPredicate();
+      }
+      E.Predicate = P;
+    } else if (I.isCommutative() && E.Ops[0] > E.Ops[1]) {
+      std::swap(E.Ops[0], E.Ops[1]);
+    } else if (GetElementPtrInst *GEP = dyn_cast<GetElementPtrInst>(&I)) {
+      E.SourceTy = GEP->getSourceElementType();
+    }
+    return E;
   }
-  return i.isIdenticalTo(&j);
+
+private:
+  DenseMap<Value*, unsigned> Numbers;
+  unsigned Next = 1;
+};
+
+} // end anonymous namespace
+
+bool _IsValueNumberable(Instruction &I) {
+  // only side-effect free computations whose result depends on nothing
+  // but their operands may be merged
+  return isa<BinaryOperator>(I) ||
+         isa<UnaryOperator>(I) ||
+         isa<CastInst>(I) ||
+         isa<CmpInst>(I) ||
+         isa<SelectInst>(I) ||
+         isa<GetElementPtrInst>(I);
 }
 
-void _ReplaceAllUsesInBlock(BasicBlock::iterator &startingInstruction, BasicBlock::iterator &end, llvm::Instruction  &i) {
-  while(startingInstruction != end) {
-    if (_AreInstructionsLiteralMatches(i, *startingInstruction)) {
-      llvm::Instruction *rm = &(*startingInstruction);
-      startingInstruction++;
-      rm->replaceAllUsesWith(&i);
-      rm->eraseFromParent();
-      CSEElim++;
+static void _ValueNumberBlock(BasicBlock &BB, ValueNumbering &VN, ExpressionTable &Table) {
+  for (Instruction &I : make_early_inc_range(BB)) {
+    if (!_IsValueNumberable(I))
+      continue;
+
+    Expression E = VN.createExpression(I);
+    if (Instruction *Leader = Table.lookup(E)) {
+      // the leader dominates I, so it may stand in for it everywhere
+      Leader->andIRFlags(&I);
+      I.replaceAllUsesWith(Leader);
+      I.eraseFromParent();
+      CSEStats.Elim++;
     } else {
-      startingInstruction++;
+      Table.insert(E, &I);
     }
   }
 }
 
+/*
+ * Visit every block reachable from the entry in dominator tree preorder.
+ * Enter is called before any block it dominates is visited and Leave once
+ * all of them have been, which lets callers maintain scoped state.
+ */
+void _WalkDominatorTree(Function &F, function_ref<void(BasicBlock&)> Enter,
+                        function_ref<void(BasicBlock&)> Leave)
+{
+  // explicit stack so deep dominator trees cannot overflow the C stack;
+  // each entry walks the contiguous child array of its block
+  struct StackNode {
+    BasicBlock *BB;
+    const LLVMBasicBlockRef *Child;
+    const LLVMBasicBlockRef *End;
+  };
+  std::vector<StackNode> Stack;
+
+  auto Push = [&](BasicBlock *BB) {
+    unsigned Count;
+    const LLVMBasicBlockRef *Children = LLVMGetDomChildren(wrap(BB), &Count);
+    Enter(*BB);
+    Stack.push_back({BB, Children, Children + Count});
+  };
+
+  Push(&F.getEntryBlock());
+
+  while (!Stack.empty()) {
+    StackNode &Top = Stack.back();
+    if (Top.Child == Top.End) {
+      Leave(*Top.BB);
+      Stack.pop_back();
+      continue;
+    }
+
+    Push(unwrap(*Top.Child++));
+  }
+}
+
+static void _RunValueNumbering(Function &F) {
+  if (F.isDeclaration())
+    return;
+
+  ValueNumbering VN;
+  ExpressionTable Table;
+  std::vector<std::unique_ptr<ExpressionScope>> Scopes;
+
+  _WalkDominatorTree(F,
+    [&](BasicBlock &BB) {
+      Scopes.push_back(std::make_unique<ExpressionScope>(Table));
+      _ValueNumberBlock(BB, VN, Table);
+    },
+    [&](BasicBlock &) {
+      Scopes.pop_back();
+    });
+}
+
 void RunCommonSubExpressionElimination(Module &M) {
-   for (Module::iterator f = M.begin(); f != M.end(); f++) {
-    for (Function::iterator bb=(*f).begin(); bb!=(*f).end(); bb++) {
-      for (BasicBlock::iterator inst_iter = (*bb).begin(); inst_iter != (*bb).end(); inst_iter++) {
-          // iterate through all the instructions that dominate inst_iter
-          BasicBlock::iterator next_iter = inst_iter;
-          next_iter++;
-          BasicBlock::iterator currEnd = (*bb).end();
-          llvm::BasicBlock *currBlock = (*inst_iter).getParent();
-          while (currBlock != nullptr) {
-            currEnd = currBlock->end();
-            _ReplaceAllUsesInBlock(next_iter, currEnd, *inst_iter);
-            currBlock = unwrap(LLVMNextDomChild(wrap(&*bb), wrap(currBlock)));
-          }
+  for (Module::iterator f = M.begin(); f != M.end(); f++) {
+    PassProfile Profile("cse", *f);
+    _RunValueNumbering(*f);
+  }
+}
+
+/*
+ * Redundant load elimination
+ *
+ *   Memory is split into classes.  An alloca whose address is only ever
+ *   used directly as the pointer operand of loads and stores cannot be
+ *   reached through any other pointer, so it forms a class of its own;
+ *   everything else (globals, arguments, escaped allocas) shares a single
+ *   class.  A write to one class never clobbers another, which keeps loads
+ *   of C-- locals alive across calls and stores to other locals.
+ *
+ *   Each class remembers the generation of its last clobber.  A load is
+ *   recorded with the generation current when it executed and may be
+ *   reused as long as no clobber of its class has happened since.  A store
+ *   records the value it wrote the same way, so a later load of that
+ *   address is forwarded the stored value.  Blocks
+ *   that can be entered from somewhere other than their immediate dominator
+ *   clobber every class, since the other paths were not observed.
+ */
+namespace {
+
+struct AvailableValue {
+  Value *V;
+  unsigned Generation;
+  bool FromStore;
+};
+
+typedef std::pair<Value*, Type*> MemoryKey;
+typedef ScopedHashTable<MemoryKey, AvailableValue> MemoryTable;
+typedef ScopedHashTableScope<MemoryKey, AvailableValue> MemoryScope;
+
+class MemoryGenerations {
+public:
+  unsigned current() const { return Generation; }
+
+  // clobbering the All marker invalidates every class at once
+  void clobberAll() { clobber(&All); }
+
+  void clobber(const void *Class) {
+    auto &Last = LastClobber[Class];
+    UndoLog.push_back(std::make_pair(Class, Last));
+    Last = ++Generation;
+  }
+
+  bool isAvailable(const void *Class, unsigned Gen) const {
+    return Gen >= lastClobber(Class) && Gen >= lastClobber(&All);
+  }
+
+  size_t mark() const { return UndoLog.size(); }
+
+  void rollback(size_t Mark) {
+    while (UndoLog.size() > Mark) {
+      LastClobber[UndoLog.back().first] = UndoLog.back().second;
+      UndoLog.pop_back();
+    }
+  }
+
+private:
+  unsigned lastClobber(const void *Class) const {
+    auto It = LastClobber.find(Class);
+    return It == LastClobber.end() ? 0 : It->second;
+  }
+
+  char All;
+  unsigned Generation = 0;
+  DenseMap<const void*, unsigned> LastClobber;
+  std::vector<std::pair<const void*, unsigned>> UndoLog;
+};
+
+} // end anonymous namespace
+
+bool _IsTrackedAlloca(AllocaInst *AI) {
+  for (User *U : AI->users()) {
+    if (LoadInst *LI = dyn_cast<LoadInst>(U)) {
+      if (LI->getPointerOperand() != AI)
+        return false;
+    } else if (StoreInst *SI = dyn_cast<StoreInst>(U)) {
+      if (SI->getPointerOperand() != AI || SI->getValueOperand() == AI)
+        return false;
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void _CollectTrackedAllocas(Function &F, SmallPtrSetImpl<Value*> &Tracked) {
+  for (Instruction &I : instructions(F))
+    if (AllocaInst *AI = dyn_cast<AllocaInst>(&I))
+      if (_IsTrackedAlloca(AI))
+        Tracked.insert(AI);
+}
+
+static const void *_MemoryClass(Value *Ptr, const SmallPtrSetImpl<Value*> &Tracked) {
+  // null stands for every location that is not a tracked alloca
+  return Tracked.count(Ptr) ? Ptr : nullptr;
+}
+
+static void _EliminateRedundantLoadsInBlock(BasicBlock &BB, MemoryTable &Table,
+                                            MemoryGenerations &Gen,
+                                            const SmallPtrSetImpl<Value*> &Tracked)
+{
+  for (Instruction &I : make_early_inc_range(BB)) {
+    if (LoadInst *LI = dyn_cast<LoadInst>(&I)) {
+      if (LI->isSimple()) {
+        Value *Ptr = LI->getPointerOperand();
+        MemoryKey Key(Ptr, LI->getType());
+        AvailableValue AV = Table.lookup(Key);
+        if (AV.V && Gen.isAvailable(_MemoryClass(Ptr, Tracked), AV.Generation)) {
+          LI->replaceAllUsesWith(AV.V);
+          LI->eraseFromParent();
+          if (AV.FromStore)
+            CSEStats.LdStElim++;
+          else
+            CSEStats.LdElim++;
+        } else {
+          Table.insert(Key, {LI, Gen.current(), false});
         }
+        continue;
+      }
+    } else if (StoreInst *SI = dyn_cast<StoreInst>(&I)) {
+      if (SI->isSimple()) {
+        Value *Ptr = SI->getPointerOperand();
+        Value *Val = SI->getValueOperand();
+        Gen.clobber(_MemoryClass(Ptr, Tracked));
+        Table.insert(MemoryKey(Ptr, Val->getType()), {Val, Gen.current(), true});
+        continue;
       }
+    }
+
+    if (I.isAtomic() || I.isVolatile())
+      Gen.clobberAll();
+    else if (I.mayWriteToMemory())
+      Gen.clobber(nullptr);
   }
 }
 
-void RunDeadCodeElimination(Module &M) {
-  std::set<Instruction*> worklist;
+static void _RunRedundantLoadElimination(Function &F) {
+  if (F.isDeclaration())
+    return;
+
+  SmallPtrSet<Value*, 16> Tracked;
+  _CollectTrackedAllocas(F, Tracked);
+
+  MemoryTable Table;
+  MemoryGenerations Gen;
+  std::vector<std::unique_ptr<MemoryScope>> Scopes;
+  std::vector<size_t> Marks;
+
+  _WalkDominatorTree(F,
+    [&](BasicBlock &BB) {
+      Scopes.push_back(std::make_unique<MemoryScope>(Table));
+      Marks.push_back(Gen.mark());
+      // other paths into BB were not seen by this walk
+      if (&BB != &F.getEntryBlock() &&
+          BB.getSinglePredecessor() != unwrap(LLVMImmDom(wrap(&BB))))
+        Gen.clobberAll();
+      _EliminateRedundantLoadsInBlock(BB, Table, Gen, Tracked);
+    },
+    [&](BasicBlock &) {
+      Gen.rollback(Marks.back());
+      Marks.pop_back();
+      Scopes.pop_back();
+    });
+}
 
+void RunRedundantLoadElimination(Module &M) {
   for (Module::iterator f = M.begin(); f != M.end(); f++) {
-    for (Function::iterator bb=(*f).begin(); bb!=(*f).end(); bb++) {
-      for (BasicBlock::iterator I = (*bb).begin(); I != (*bb).end(); I++) {
-        if (_isDead(*I)) {
-          CSEDead++;
+    PassProfile Profile("rle", *f);
+    _RunRedundantLoadElimination(*f);
+  }
+}
+
+/*
+ * Dead store elimination
+ *
+ *   Three kinds of store are removed.  A store to a tracked alloca that
+ *   is never loaded from can't be observed at all, so the alloca and all
+ *   its stores go.  A store to a tracked alloca that no path from it reads
+ *   before the alloca is overwritten or the function returns is dead, which
+ *   a backward liveness pass over the tracked allocas finds.  Within a
+ *   block, a store that is overwritten by a later store to the same address
+ *   before anything may read it is dead as well.
+ */
+static void _EliminateUnreadAllocas(Function &F) {
+  std::vector<AllocaInst*> Unread;
+  for (Instruction &I : instructions(F)) {
+    AllocaInst *AI = dyn_cast<AllocaInst>(&I);
+    if (AI && _IsTrackedAlloca(AI) &&
+        none_of(AI->users(), [](User *U) { return isa<LoadInst>(U); }))
+      Unread.push_back(AI);
+  }
+
+  for (AllocaInst *AI : Unread) {
+    while (!AI->use_empty()) {
+      cast<Instruction>(AI->user_back())->eraseFromParent();
+      CSEStats.RStElim++;
+    }
+    AI->eraseFromParent();
+  }
+}
+
+/* Only loads read a tracked alloca, and only a store of the whole
+   allocated type is sure to overwrite all of it */
+static bool _KillsAlloca(StoreInst *SI, AllocaInst *AI) {
+  return SI->isSimple() && SI->getValueOperand()->getType() == AI->getAllocatedType();
+}
+
+static void _EliminateStoresToDeadAllocas(Function &F,
+                                          const SmallPtrSetImpl<Value*> &Tracked)
+{
+  if (Tracked.empty())
+    return;
+
+  DenseMap<const Value*, unsigned> Index;
+  for (Value *V : Tracked)
+    Index.insert(std::make_pair(V, (unsigned)Index.size()));
+  unsigned N = Index.size();
+
+  // per block: allocas read before being overwritten, and those overwritten
+  DenseMap<BasicBlock*, BitVector> Gen, Kill, LiveIn, LiveOut;
+  for (BasicBlock &BB : F) {
+    BitVector &G = Gen[&BB], &K = Kill[&BB];
+    G.resize(N);
+    K.resize(N);
+    LiveIn[&BB].resize(N);
+    LiveOut[&BB].resize(N);
+    for (Instruction &I : reverse(BB)) {
+      if (LoadInst *LI = dyn_cast<LoadInst>(&I)) {
+        auto It = Index.find(LI->getPointerOperand());
+        if (It != Index.end())
+          G.set(It->second);
+      } else if (StoreInst *SI = dyn_cast<StoreInst>(&I)) {
+        auto It = Index.find(SI->getPointerOperand());
+        if (It != Index.end() &&
+            _KillsAlloca(SI, cast<AllocaInst>(SI->getPointerOperand()))) {
+          K.set(It->second);
+          G.reset(It->second);
         }
       }
     }
   }
+
+  // live-out is the union of the successors' live-in; blocks are visited
+  // last to first so most information flows in one sweep
+  bool Changed = true;
+  while (Changed) {
+    Changed = false;
+    for (BasicBlock &BB : reverse(F)) {
+      BitVector &Out = LiveOut[&BB];
+      for (BasicBlock *Succ : successors(&BB))
+        Out |= LiveIn[Succ];
+
+      BitVector In = Out;
+      In.reset(Kill[&BB]);
+      In |= Gen[&BB];
+      if (In != LiveIn[&BB]) {
+        LiveIn[&BB] = std::move(In);
+        Changed = true;
+      }
+    }
+  }
+
+  for (BasicBlock &BB : F) {
+    BitVector Live = LiveOut[&BB];
+    for (Instruction &I : make_early_inc_range(reverse(BB))) {
+      if (LoadInst *LI = dyn_cast<LoadInst>(&I)) {
+        auto It = Index.find(LI->getPointerOperand());
+        if (It != Index.end())
+          Live.set(It->second);
+      } else if (StoreInst *SI = dyn_cast<StoreInst>(&I)) {
+        auto It = Index.find(SI->getPointerOperand());
+        if (It == Index.end() || !SI->isSimple())
+          continue;
+        if (!Live.test(It->second)) {
+          SI->eraseFromParent();
+          CSEStats.RStElim++;
+        } else if (_KillsAlloca(SI, cast<AllocaInst>(SI->getPointerOperand()))) {
+          Live.reset(It->second);
+        }
+      }
+    }
+  }
+}
+
+static void _EliminateOverwrittenStoresInBlock(BasicBlock &BB,
+                                               const SmallPtrSetImpl<Value*> &Tracked)
+{
+  // stores not yet read by anything, keyed on their address
+  DenseMap<Value*, StoreInst*> Pending;
+
+  auto ForgetUntracked = [&]() {
+    for (auto It = Pending.begin(); It != Pending.end(); ++It)
+      if (!Tracked.count(It->first))
+        Pending.erase(It);
+  };
+
+  for (Instruction &I : make_early_inc_range(BB)) {
+    if (I.isAtomic() || I.isVolatile()) {
+      Pending.clear();
+    } else if (LoadInst *LI = dyn_cast<LoadInst>(&I)) {
+      Value *Ptr = LI->getPointerOperand();
+      if (Tracked.count(Ptr))
+        Pending.erase(Ptr);
+      else
+        ForgetUntracked();
+    } else if (StoreInst *SI = dyn_cast<StoreInst>(&I)) {
+      StoreInst *&Last = Pending[SI->getPointerOperand()];
+      if (Last && Last->getValueOperand()->getType() ==
+                  SI->getValueOperand()->getType()) {
+        Last->eraseFromParent();
+        CSEStats.RStElim++;
+      }
+      Last = SI;
+    } else if (I.mayReadFromMemory()) {
+      // tracked allocas are unreachable from calls and other readers
+      ForgetUntracked();
+    }
+  }
+}
+
+static void _RunDeadStoreElimination(Function &F) {
+  if (F.isDeclaration())
+    return;
+
+  _EliminateUnreadAllocas(F);
+
+  SmallPtrSet<Value*, 16> Tracked;
+  _CollectTrackedAllocas(F, Tracked);
+
+  _EliminateStoresToDeadAllocas(F, Tracked);
+  for (BasicBlock &BB : F)
+    _EliminateOverwrittenStoresInBlock(BB, Tracked);
+}
+
+void RunDeadStoreElimination(Module &M) {
+  for (Module::iterator f = M.begin(); f != M.end(); f++) {
+    PassProfile Profile("dse", *f);
+    _RunDeadStoreElimination(*f);
+  }
+}
+
+/*
+ * Dead code elimination
+ *
+ *   Erasing a dead instruction drops the last use of some of its operands,
+ *   so those are pushed onto the worklist as soon as they become unused.
+ *   An instruction can only become unused once, so nothing is queued twice
+ *   and whole chains of dead code go in a single pass.
+ */
+static void _RunDeadCodeElimination(Function &F) {
+  SmallVector<Instruction*, 64> Worklist;
+
+  for (Instruction &I : instructions(F))
+    if (_isDead(I))
+      Worklist.push_back(&I);
+
+  while (!Worklist.empty()) {
+    Instruction *I = Worklist.pop_back_val();
+
+    for (Use &U : I->operands()) {
+      Instruction *Op = dyn_cast<Instruction>(U.get());
+      U.set(nullptr);
+      if (Op && Op->use_empty() && _isDead(*Op))
+        Worklist.push_back(Op);
+    }
+
+    I->eraseFromParent();
+    CSEStats.Dead++;
+  }
+}
+
+void RunDeadCodeElimination(Module &M) {
+  for (Module::iterator f = M.begin(); f != M.end(); f++) {
+    PassProfile Profile("dce", *f);
+    _RunDeadCodeElimination(*f);
+  }
 }
 
 bool _isDead(Instruction &I) {
@@ -204,48 +770,413 @@ bool _isDead(Instruction &I) {
   return false;
 }
 
+/*
+ * Constant folding
+ *
+ *   The arithmetic is done on APInts so every width wraps exactly as it
+ *   would at run time.  Operations whose result is undefined (division by
+ *   zero, INT_MIN / -1, shifting by the bit width or more) are left alone.
+ */
+bool _FoldBinaryOperator(unsigned Opcode, const APInt &L, const APInt &R, APInt &Result)
+{
+  bool Overflow = false;
+  switch (Opcode) {
+  case Instruction::Add:  Result = L + R; return true;
+  case Instruction::Sub:  Result = L - R; return true;
+  case Instruction::Mul:  Result = L * R; return true;
+  case Instruction::And:  Result = L & R; return true;
+  case Instruction::Or:   Result = L | R; return true;
+  case Instruction::Xor:  Result = L ^ R; return true;
+  case Instruction::UDiv:
+  case Instruction::URem:
+    if (R.isZero())
+      return false;
+    Result = Opcode == Instruction::UDiv ? L.udiv(R) : L.urem(R);
+    return true;
+  case Instruction::SDiv:
+  case Instruction::SRem:
+    if (R.isZero())
+      return false;
+    Result = L.sdiv_ov(R, Overflow);
+    if (Overflow)
+      return false;
+    if (Opcode == Instruction::SRem)
+      Result = L.srem(R);
+    return true;
+  case Instruction::Shl:
+  case Instruction::LShr:
+  case Instruction::AShr:
+    if (R.uge(L.getBitWidth()))
+      return false;
+    if (Opcode == Instruction::Shl)
+      Result = L.shl(R);
+    else if (Opcode == Instruction::LShr)
+      Result = L.lshr(R);
+    else
+      Result = L.ashr(R);
+    return true;
+  default:
+    return false;
+  }
+}
+
+bool _FoldCast(unsigned Opcode, const APInt &V, unsigned DestWidth, APInt &Result)
+{
+  switch (Opcode) {
+  case Instruction::Trunc: Result = V.trunc(DestWidth); return true;
+  case Instruction::ZExt:  Result = V.zext(DestWidth);  return true;
+  case Instruction::SExt:  Result = V.sext(DestWidth);  return true;
+  default:
+    return false;
+  }
+}
+
 bool isFoldable(Instruction &I)
 {
-  int opcode = I.getOpcode(); //returns a member of the enums: unsigned llvm::Instruction::getOpcode ( ) const
+  int opcode = I.getOpcode();
   switch(opcode)
-  {       //all integer types can be folded aggressively
-  case Instruction::Add:
-  case Instruction::Sub:
-  case Instruction::Mul:
+  {
+  case Instruction::UDiv:
   case Instruction::SDiv:
-    if (I.getOperand(1)==0) //if divide by 0, return false, is not foldable
+  case Instruction::URem:
+  case Instruction::SRem:
     {
-      return false;
+      // dividing by a zero constant is undefined, so leave it be
+      ConstantInt *Divisor = dyn_cast<ConstantInt>(I.getOperand(1));
+      if (Divisor == nullptr || Divisor->isZero())
+        return false;
+      return isa<ConstantInt>(I.getOperand(0));
     }
-  case Instruction::UDiv:
-    if (I.getOperand(1)==0) //if divide by 0, return false, is not foldable
+  case Instruction::Add:
+  case Instruction::Sub:
+  case Instruction::Mul:
+  case Instruction::Shl:
+  case Instruction::LShr:
+  case Instruction::AShr:
+  case Instruction::And:
+  case Instruction::Or:
+  case Instruction::Xor:
+  case Instruction::ICmp:
+    return isa<ConstantInt>(I.getOperand(0)) && isa<ConstantInt>(I.getOperand(1));
+  case Instruction::Trunc:
+  case Instruction::ZExt:
+  case Instruction::SExt:
+    return isa<ConstantInt>(I.getOperand(0));
+  case Instruction::Select:
     {
-      return false;
+      SelectInst *SI = cast<SelectInst>(&I);
+      return isa<ConstantInt>(SI->getCondition()) ||
+             SI->getTrueValue() == SI->getFalseValue();
     }
-    return true;
   default:
     return false;
+  }
+}
+
+// Returns the value I computes, or null if it can't be folded.
+Value *_FoldInstruction(Instruction &I)
+{
+  if (!isFoldable(I))
+    return nullptr;
 
+  if (SelectInst *SI = dyn_cast<SelectInst>(&I)) {
+    if (SI->getTrueValue() == SI->getFalseValue())
+      return SI->getTrueValue();
+    return cast<ConstantInt>(SI->getCondition())->isOne() ? SI->getTrueValue()
+                                                          : SI->getFalseValue();
   }
-    return false;
+
+  const APInt &L = cast<ConstantInt>(I.getOperand(0))->getValue();
+  APInt Result;
+
+  if (ICmpInst *CI = dyn_cast<ICmpInst>(&I)) {
+    const APInt &R = cast<ConstantInt>(I.getOperand(1))->getValue();
+    return ConstantInt::get(I.getType(), ICmpInst::compare(L, R, CI->getPredicate()));
+  }
+
+  if (isa<CastInst>(I)) {
+    if (!_FoldCast(I.getOpcode(), L, I.getType()->getIntegerBitWidth(), Result))
+      return nullptr;
+    return ConstantInt::get(I.getType(), Result);
+  }
+
+  const APInt &R = cast<ConstantInt>(I.getOperand(1))->getValue();
+  if (!_FoldBinaryOperator(I.getOpcode(), L, R, Result))
+    return nullptr;
+  return ConstantInt::get(I.getType(), Result);
 }
 
+static void _RunConstantFolding(Function &F)
+{
+  // a folded instruction may make its users foldable, so they are queued
+  // again; Queued tells live worklist entries from stale ones
+  SmallVector<Instruction*, 64> Worklist;
+  SmallPtrSet<Instruction*, 32> Queued;
+
+  for (Instruction &I : instructions(F)) {
+    Worklist.push_back(&I);
+    Queued.insert(&I);
+  }
+  std::reverse(Worklist.begin(), Worklist.end());
+
+  while (!Worklist.empty()) {
+    Instruction *I = Worklist.pop_back_val();
+    if (!Queued.erase(I))
+      continue;
+
+    Value *V = _FoldInstruction(*I);
+    if (V == nullptr)
+      continue;
+
+    for (User *U : I->users())
+      if (Queued.insert(cast<Instruction>(U)).second)
+        Worklist.push_back(cast<Instruction>(U));
+
+    I->replaceAllUsesWith(V);
+    I->eraseFromParent();
+    CSEStats.Simplify++;
+  }
+}
 
 void RunConstantFolding(Module &M)  //goal: compiler should compute constants on its own
 {
-  for(auto f = M.begin(); f!=M.end(); f++)       // loop over functions, where auto is Module:: iterator
+  for(auto f = M.begin(); f!=M.end(); f++)
+    {
+      PassProfile Profile("constfold", *f);
+      _RunConstantFolding(*f);
+    }
+}
+
+/*
+ * Peephole simplification
+ *
+ *   Algebraic identities and strength reductions are declared as rows of
+ *   PeepholeRules: an opcode, what its right-hand operand must look like,
+ *   and what the instruction is rewritten into.  Commutative operations
+ *   have a lone constant moved to the right first so one row covers both
+ *   orders.  For each opcode the first matching row wins.
+ */
+namespace {
+
+enum class OperandMatch {
+  Zero,          // RHS is 0
+  One,           // RHS is 1
+  AllOnes,       // RHS is -1
+  SameAsLHS,     // RHS is the LHS
+  PowerOfTwo,    // RHS is a positive power of two
+  DivisorConst   // RHS is a constant other than 0, 1, -1 or INT_MIN
+};
+
+enum class RewriteAction {
+  LHS,           // x
+  Zero,          // 0
+  ShiftLeft,     // x << log2(c)
+  UnsignedShift, // x >>u log2(c)
+  SignedShift,   // (x + ((x >>s w-1) >>u w-k)) >>s k
+  MagicMultiply  // high half of x * magic, corrected and shifted
+};
+
+struct PeepholeRule {
+  unsigned Opcode;
+  OperandMatch Match;
+  RewriteAction Action;
+};
+
+constexpr PeepholeRule PeepholeRules[] = {
+  { Instruction::Add,  OperandMatch::Zero,         RewriteAction::LHS           },
+  { Instruction::Sub,  OperandMatch::Zero,         RewriteAction::LHS           },
+  { Instruction::Sub,  OperandMatch::SameAsLHS,    RewriteAction::Zero          },
+  { Instruction::Mul,  OperandMatch::Zero,         RewriteAction::Zero          },
+  { Instruction::Mul,  OperandMatch::One,          RewriteAction::LHS           },
+  { Instruction::Mul,  OperandMatch::PowerOfTwo,   RewriteAction::ShiftLeft     },
+  { Instruction::UDiv, OperandMatch::One,          RewriteAction::LHS           },
+  { Instruction::UDiv, OperandMatch::PowerOfTwo,   RewriteAction::UnsignedShift },
+  { Instruction::SDiv, OperandMatch::One,          RewriteAction::LHS           },
+  { Instruction::SDiv, OperandMatch::PowerOfTwo,   RewriteAction::SignedShift   },
+  { Instruction::SDiv, OperandMatch::DivisorConst, RewriteAction::MagicMultiply },
+  { Instruction::URem, OperandMatch::One,          RewriteAction::Zero          },
+  { Instruction::SRem, OperandMatch::One,          RewriteAction::Zero          },
+  { Instruction::SRem, OperandMatch::AllOnes,      RewriteAction::Zero          },
+  { Instruction::Shl,  OperandMatch::Zero,         RewriteAction::LHS           },
+  { Instruction::LShr, OperandMatch::Zero,         RewriteAction::LHS           },
+  { Instruction::AShr, OperandMatch::Zero,         RewriteAction::LHS           },
+  { Instruction::And,  OperandMatch::Zero,         RewriteAction::Zero          },
+  { Instruction::And,  OperandMatch::AllOnes,      RewriteAction::LHS           },
+  { Instruction::And,  OperandMatch::SameAsLHS,    RewriteAction::LHS           },
+  { Instruction::Or,   OperandMatch::Zero,         RewriteAction::LHS           },
+  { Instruction::Or,   OperandMatch::SameAsLHS,    RewriteAction::LHS           },
+  { Instruction::Xor,  OperandMatch::Zero,         RewriteAction::LHS           },
+  { Instruction::Xor,  OperandMatch::SameAsLHS,    RewriteAction::Zero          },
+};
+
+constexpr bool _IsValidPeepholeRule(const PeepholeRule &R) {
+  // the rewrites that need a log2 or a magic number only make sense for
+  // the operand kinds that provide one
+  switch (R.Action) {
+  case RewriteAction::ShiftLeft:
+    return R.Opcode == Instruction::Mul && R.Match == OperandMatch::PowerOfTwo;
+  case RewriteAction::UnsignedShift:
+    return R.Opcode == Instruction::UDiv && R.Match == OperandMatch::PowerOfTwo;
+  case RewriteAction::SignedShift:
+    return R.Opcode == Instruction::SDiv && R.Match == OperandMatch::PowerOfTwo;
+  case RewriteAction::MagicMultiply:
+    return R.Opcode == Instruction::SDiv && R.Match == OperandMatch::DivisorConst;
+  default:
+    return R.Match != OperandMatch::PowerOfTwo && R.Match != OperandMatch::DivisorConst;
+  }
+}
+
+constexpr bool _ArePeepholeRulesValid() {
+  for (unsigned i = 0; i < sizeof(PeepholeRules) / sizeof(PeepholeRules[0]); i++) {
+    if (!_IsValidPeepholeRule(PeepholeRules[i]))
+      return false;
+    if (PeepholeRules[i].Opcode < Instruction::BinaryOpsBegin ||
+        PeepholeRules[i].Opcode >= Instruction::BinaryOpsEnd)
+      return false;
+    // rows for one opcode must be adjacent so the first match is the best
+    for (unsigned j = i + 2; j < sizeof(PeepholeRules) / sizeof(PeepholeRules[0]); j++)
+      if (PeepholeRules[j].Opcode == PeepholeRules[i].Opcode &&
+          PeepholeRules[j - 1].Opcode != PeepholeRules[i].Opcode)
+        return false;
+  }
+  return true;
+}
+
+static_assert(_ArePeepholeRulesValid(), "malformed row in PeepholeRules");
+
+} // end anonymous namespace
+
+static bool _MatchOperand(OperandMatch Match, Value *LHS, Value *RHS)
+{
+  if (Match == OperandMatch::SameAsLHS)
+    return LHS == RHS;
+
+  ConstantInt *C = dyn_cast<ConstantInt>(RHS);
+  if (C == nullptr)
+    return false;
+
+  const APInt &V = C->getValue();
+  switch (Match) {
+  case OperandMatch::Zero:       return V.isZero();
+  case OperandMatch::One:        return V.isOne();
+  case OperandMatch::AllOnes:    return V.isAllOnes();
+  case OperandMatch::PowerOfTwo: return V.isStrictlyPositive() && V.isPowerOf2();
+  case OperandMatch::DivisorConst:
+    return !V.isZero() && !V.isOne() && !V.isAllOnes() && !V.isMinSignedValue();
+  default:
+    return false;
+  }
+}
+
+static Value *_ApplyRewrite(RewriteAction Action, BinaryOperator &I)
+{
+  Value *X = I.getOperand(0);
+  Type *Ty = I.getType();
+  unsigned Width = Ty->getIntegerBitWidth();
+
+  if (Action == RewriteAction::LHS)
+    return X;
+  if (Action == RewriteAction::Zero)
+    return ConstantInt::get(Ty, 0);
+
+  const APInt &C = cast<ConstantInt>(I.getOperand(1))->getValue();
+  IRBuilder<> Builder(&I);
+
+  switch (Action) {
+  case RewriteAction::ShiftLeft:
+    return Builder.CreateShl(X, C.logBase2());
+  case RewriteAction::UnsignedShift:
+    return Builder.CreateLShr(X, C.logBase2());
+  case RewriteAction::SignedShift:
+    {
+      // round towards zero: negative dividends are biased by 2^k - 1
+      unsigned K = C.logBase2();
+      Value *Sign = Builder.CreateAShr(X, Width - 1);
+      Value *Bias = Builder.CreateLShr(Sign, Width - K);
+      return Builder.CreateAShr(Builder.CreateAdd(X, Bias), K);
+    }
+  case RewriteAction::MagicMultiply:
     {
-      for(auto bb= f->begin(); bb!=f->end(); bb++)  // loop over functions, where auto is Function:: iterator
-         {
-            // loop over basic blocks
-           for(auto i = bb->begin(); i != bb->end(); i++) // loop over functions, where auto is BasicBlock:: iterator
-               {
-                 if (isFoldable(*i))
-                  {
-                     LLVMValueRef InstructionSimplify(LLVMValueRef I);
-                     CSESimplify++;
-                  }
-              }
-          }
+      SignedDivisionByConstantInfo Magic = SignedDivisionByConstantInfo::get(C);
+      Type *WideTy = IntegerType::get(I.getContext(), Width * 2);
+
+      Value *Wide = Builder.CreateMul(Builder.CreateSExt(X, WideTy),
+                                      ConstantInt::get(WideTy, Magic.Magic.sext(Width * 2)));
+      Value *Q = Builder.CreateTrunc(Builder.CreateAShr(Wide, Width), Ty);
+      if (C.isStrictlyPositive() && Magic.Magic.isNegative())
+        Q = Builder.CreateAdd(Q, X);
+      if (C.isNegative() && Magic.Magic.isStrictlyPositive())
+        Q = Builder.CreateSub(Q, X);
+      if (Magic.ShiftAmount)
+        Q = Builder.CreateAShr(Q, Magic.ShiftAmount);
+      // add one to negative quotients to round towards zero
+      return Builder.CreateAdd(Q, Builder.CreateLShr(Q, Width - 1));
+    }
+  default:
+    return nullptr;
+  }
+}
+
+// Returns the value I simplifies to, or null if no rule applies.
+Value *_SimplifyInstruction(Instruction &I)
+{
+  BinaryOperator *BO = dyn_cast<BinaryOperator>(&I);
+  if (BO == nullptr || !BO->getType()->isIntegerTy())
+    return nullptr;
+
+  if (BO->isCommutative() && isa<ConstantInt>(BO->getOperand(0)) &&
+      !isa<ConstantInt>(BO->getOperand(1)))
+    BO->swapOperands();
+
+  Value *LHS = BO->getOperand(0);
+  Value *RHS = BO->getOperand(1);
+  for (const PeepholeRule &R : PeepholeRules)
+    if (R.Opcode == BO->getOpcode() && _MatchOperand(R.Match, LHS, RHS)) {
+      // each rewrite is counted once: identities as simplifications,
+      // the rest as strength reductions
+      if (R.Action != RewriteAction::LHS && R.Action != RewriteAction::Zero)
+        CSEStats.Strength++;
+      else
+        CSEStats.Simplify++;
+      return _ApplyRewrite(R.Action, *BO);
     }
+
+  return nullptr;
+}
+
+static void _RunPeepholeSimplifier(Function &F)
+{
+  SmallVector<Instruction*, 64> Worklist;
+  SmallPtrSet<Instruction*, 32> Queued;
+
+  for (Instruction &I : instructions(F)) {
+    Worklist.push_back(&I);
+    Queued.insert(&I);
+  }
+  std::reverse(Worklist.begin(), Worklist.end());
+
+  while (!Worklist.empty()) {
+    Instruction *I = Worklist.pop_back_val();
+    if (!Queued.erase(I))
+      continue;
+
+    Value *V = _SimplifyInstruction(*I);
+    if (V == nullptr)
+      continue;
+
+    for (User *U : I->users())
+      if (Queued.insert(cast<Instruction>(U)).second)
+        Worklist.push_back(cast<Instruction>(U));
+
+    I->replaceAllUsesWith(V);
+    I->eraseFromParent();
+  }
+}
+
+void RunPeepholeSimplification(Module &M)
+{
+  for (Module::iterator f = M.begin(); f != M.end(); f++) {
+    PassProfile Profile("peephole", *f);
+    _RunPeepholeSimplifier(*f);
+  }
 }
@@ -11,13 +11,115 @@
 #include "llvm/IR/Module.h"
 #include "llvm/PassRegistry.h"
 #include "llvm/IR/IRBuilder.h"
-bool _AreInstructionsLiteralMatches(llvm::Instruction &i, llvm::Instruction &j);
-void _ReplaceAllUsesInBlock(BasicBlock::iterator &startingInstruction, BasicBlock::iterator &end, llvm::Instruction  &i);
+#include "llvm/Transforms/Utils/ValueMapper.h"
+#include <chrono>
+#include <string>
+#include <vector>
+#include "dominance.h"
+
+bool _IsValueNumberable(llvm::Instruction &I);
+bool _IsTrackedAlloca(llvm::AllocaInst *AI);
+void _WalkDominatorTree(Function &F, function_ref<void(BasicBlock&)> Enter,
+                        function_ref<void(BasicBlock&)> Leave);
 void RunCommonSubExpressionElimination(Module& M); 
+void RunRedundantLoadElimination(Module &M);
+void RunDeadStoreElimination(Module &M);
 void RunDeadCodeElimination(Module &M);
 void LLVMCommonSubexpressionElimination_Cpp(Module*);
 bool _isDead(Instruction &I);
 void RunConstantFolding(Module &M);
+void RunSparseConditionalConstantPropagation(Module &M);
+void RunPeepholeSimplification(Module &M);
+void RunPromoteMemoryToRegister(Module &M);
+void RunLoopInvariantCodeMotion(Module &M);
+void RunLoopStrengthReduction(Module &M);
+Value *_SimplifyInstruction(Instruction &I);
+bool isFoldable(Instruction &I);
+Value *_FoldInstruction(Instruction &I);
+bool _FoldBinaryOperator(unsigned Opcode, const APInt &L, const APInt &R, APInt &Result);
+bool _FoldCast(unsigned Opcode, const APInt &V, unsigned DestWidth, APInt &Result);
+
+/* One pass over one function: wall time, IR size before and after, and
+   the analyses the pass caused to be recomputed */
+struct PassRecord {
+  const char *Pass;
+  std::string Function;
+  double Seconds;
+  unsigned InstsBefore;
+  unsigned InstsAfter;
+  unsigned BlocksBefore;
+  unsigned BlocksAfter;
+  AnalysisCounts Analyses;
+};
+
+/* Counters are kept per thread so functions can be optimized
+   concurrently; the driver adds them up once every worker is done. */
+struct CSEStatistics {
+  int Dead = 0;
+  int Elim = 0;
+  int Simplify = 0;
+  int LdElim = 0;
+  int LdStElim = 0;
+  int RStElim = 0;
+  int Unreach = 0;
+  int Strength = 0;
+  int Promoted = 0;
+  int Licm = 0;
+  int IndVars = 0;
+  int CacheHits = 0;
+  int CacheMisses = 0;
+  std::vector<PassRecord> Profile;
+
+  CSEStatistics &operator+=(const CSEStatistics &O);
+};
+
+extern thread_local CSEStatistics CSEStats;
+
+/* Scope of one pass over one function; adds a PassRecord to CSEStats
+   when the CSE_PROFILE environment variable names an output file */
+class PassProfile {
+public:
+  PassProfile(const char *Pass, Function &F);
+  ~PassProfile();
+
+private:
+  const char *Pass;
+  Function &F;
+  bool Enabled;
+  std::chrono::steady_clock::time_point Start;
+  unsigned Insts = 0;
+  unsigned Blocks = 0;
+  AnalysisCounts Analyses;
+};
+
+/* Writes CSEStats.Profile as CSV if the CSE_PROFILE file name ends in
+   .csv and as JSON otherwise, then clears it */
+void WriteProfile();
+
+/* The whole pipeline over M in place, on up to Threads threads.  Returns
+   what it did rather than printing it and leaves the calling thread's
+   CSEStats alone, so a driver can optimize many modules at once and
+   report on them together. */
+CSEStatistics RunOptimizationPipeline(Module &M, unsigned Threads);
+void PrintStatistics(const CSEStatistics &Stats);
+
+void RunPipelineInParallel(Module &M, unsigned Threads,
+                           function_ref<void(Module&)> Pipeline);
+
+/* Optimizes only the functions whose bodies are not in the cache in
+   Directory; false if the module cannot be split up for caching or the
+   optimizer binary cannot be identified to key the entries by */
+bool RunPipelineWithCache(Module &M, const char *Directory, unsigned Threads,
+                          function_ref<void(Module&)> Pipeline);
+
+/* Shared by the parallel driver and the cache: optimizing a module in
+   bitcode form in a private context, and moving a body back */
+void _WriteBitcode(Module &M, SmallVectorImpl<char> &Bitcode,
+                   bool PreserveUseListOrder = true);
+CSEStatistics _OptimizeBitcode(const SmallVectorImpl<char> &Input,
+                               SmallVectorImpl<char> &Output,
+                               function_ref<void(Module&)> Pipeline);
+void _ReplaceFunctionBody(Function *Dst, Function *Src, ValueToValueMapTy &VMap);
 
 extern "C" {
 #endif
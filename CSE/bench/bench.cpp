@@ -0,0 +1,455 @@
+/*
+ * File: bench.cpp
+ *
+ * Description:
+ *   Scaling benchmark for the optimizer.  Synthetic modules of growing
+ *   size are generated in four shapes (straight-line code full of
+ *   duplicate expressions, a deep dominator tree, a wide switch and a
+ *   deep loop nest), and each pass is timed on a fresh copy.  For every
+ *   run it reports instructions per second, how the time grew relative
+ *   to the previous size (1.0 is linear; 2.0 means doubling the input
+ *   doubled the time per instruction, i.e. quadratic) and the peak RSS.
+ *   Each size is measured in a child process of its own, so the peak RSS
+ *   belongs to that size alone rather than to every run so far.
+ *
+ *   With --emit-cmm DIR it also writes C-- programs of the same shapes
+ *   and sizes, for timing the front end.
+ *
+ *   usage: bench [--max N] [--csv] [--emit-cmm DIR]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/* LLVM Header Files */
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Value.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/NoFolder.h"
+#include <chrono>
+#include <string>
+#include <vector>
+#include "../dominance.h"
+
+using namespace llvm;
+#include "../CSE.h"
+
+/*
+ * Generators
+ *
+ *   Every shape builds one function f(a, b, c) over i64, the only type
+ *   C-- has.  Size is the approximate number of instructions.
+ */
+
+static Function *_CreateFunction(Module &M)
+{
+  Type *I64 = Type::getInt64Ty(M.getContext());
+  FunctionType *FT = FunctionType::get(I64, {I64, I64, I64}, false);
+  return Function::Create(FT, GlobalValue::ExternalLinkage, "f", M);
+}
+
+/* One block; operands are drawn from a small window so they repeat */
+static void _GenerateStraightLine(Module &M, unsigned Size)
+{
+  Function *F = _CreateFunction(M);
+  IRBuilder<NoFolder> B(BasicBlock::Create(M.getContext(), "entry", F));
+
+  std::vector<Value*> Pool;
+  for (Argument &A : F->args())
+    Pool.push_back(&A);
+
+  for (unsigned i = 0; i < Size; i++) {
+    Value *L = Pool[(i * 7) % Pool.size()];
+    Value *R = Pool[(i * 13 + 1) % Pool.size()];
+    Value *V;
+    switch (i % 5) {
+    case 0:  V = B.CreateAdd(L, R); break;
+    case 1:  V = B.CreateMul(L, R); break;
+    case 2:  V = B.CreateXor(L, R); break;
+    case 3:  V = B.CreateSub(L, B.getInt64(i % 3)); break;
+    default: V = B.CreateAdd(B.getInt64(3), B.getInt64(4)); break;
+    }
+    if (Pool.size() < 16)
+      Pool.push_back(V);
+    else
+      Pool[i % 16] = V;
+  }
+  B.CreateRet(Pool[Size % Pool.size()]);
+}
+
+/* A chain of diamonds: each block is the immediate dominator of the next */
+static void _GenerateDeepDominatorTree(Module &M, unsigned Size)
+{
+  Function *F = _CreateFunction(M);
+  LLVMContext &C = M.getContext();
+  Value *A = F->getArg(0), *Bv = F->getArg(1);
+
+  BasicBlock *BB = BasicBlock::Create(C, "entry", F);
+  IRBuilder<NoFolder> B(BB);
+  Value *X = F->getArg(2);
+
+  for (unsigned i = 0; i < Size / 6; i++) {
+    BasicBlock *Side = BasicBlock::Create(C, "side", F);
+    BasicBlock *Next = BasicBlock::Create(C, "next", F);
+
+    Value *Sum = B.CreateAdd(A, Bv);          // the same in every block
+    Value *Cond = B.CreateICmpSLT(X, Sum);
+    B.CreateCondBr(Cond, Side, Next);
+
+    B.SetInsertPoint(Side);
+    Value *Y = B.CreateMul(X, B.CreateAdd(A, Bv));
+    B.CreateBr(Next);
+
+    B.SetInsertPoint(Next);
+    PHINode *PN = B.CreatePHI(X->getType(), 2);
+    PN->addIncoming(X, BB);
+    PN->addIncoming(Y, Side);
+    X = PN;
+    BB = Next;
+  }
+  B.CreateRet(X);
+}
+
+/* One switch whose cases all join in one block */
+static void _GenerateWideBranch(Module &M, unsigned Size)
+{
+  Function *F = _CreateFunction(M);
+  LLVMContext &C = M.getContext();
+  Value *A = F->getArg(0), *Bv = F->getArg(1);
+
+  BasicBlock *Entry = BasicBlock::Create(C, "entry", F);
+  BasicBlock *Join = BasicBlock::Create(C, "join", F);
+  IRBuilder<NoFolder> B(Entry);
+  Value *Prod = B.CreateMul(A, Bv);
+
+  unsigned Cases = std::max(Size / 5, 1u);
+  SwitchInst *SI = B.CreateSwitch(A, Join, Cases);
+  B.SetInsertPoint(Join);
+  PHINode *PN = B.CreatePHI(A->getType(), Cases + 1);
+  PN->addIncoming(Prod, Entry);
+
+  for (unsigned i = 0; i < Cases; i++) {
+    BasicBlock *Case = BasicBlock::Create(C, "case", F, Join);
+    SI->addCase(B.getInt64(i), Case);
+    B.SetInsertPoint(Case);
+    Value *V = B.CreateAdd(B.CreateMul(A, Bv), B.getInt64(i));
+    V = B.CreateXor(V, B.CreateMul(A, Bv));
+    B.CreateBr(Join);
+    PN->addIncoming(V, Case);
+  }
+
+  B.SetInsertPoint(Join);
+  B.CreateRet(PN);
+}
+
+/* Loops nested Size / 12 deep, each with invariant and scaled values */
+static void _GenerateDeepLoopNest(Module &M, unsigned Size)
+{
+  Function *F = _CreateFunction(M);
+  LLVMContext &C = M.getContext();
+  Value *A = F->getArg(0), *N = F->getArg(1);
+  Type *I64 = A->getType();
+
+  BasicBlock *Entry = BasicBlock::Create(C, "entry", F);
+  IRBuilder<NoFolder> B(Entry);
+  Value *Acc = F->getArg(2);
+
+  struct Level {
+    BasicBlock *Header, *Exit;
+    PHINode *IV, *Acc;
+  };
+  std::vector<Level> Levels;
+  BasicBlock *Pred = Entry;
+
+  unsigned Depth = std::max(Size / 12, 1u);
+  for (unsigned d = 0; d < Depth; d++) {
+    BasicBlock *Header = BasicBlock::Create(C, "w.expr", F);
+    BasicBlock *Body = BasicBlock::Create(C, "w.body", F);
+    BasicBlock *Exit = BasicBlock::Create(C, "w.exit", F);
+    B.CreateBr(Header);
+
+    B.SetInsertPoint(Header);
+    PHINode *IV = B.CreatePHI(I64, 2);
+    PHINode *AccPN = B.CreatePHI(I64, 2);
+    IV->addIncoming(B.getInt64(0), Pred);
+    AccPN->addIncoming(Acc, Pred);
+    // inner loops only run a few times so the nest stays cheap to execute
+    Value *Trip = d == 0 ? N : (Value*)B.getInt64(2);
+    B.CreateCondBr(B.CreateICmpSLT(IV, Trip), Body, Exit);
+
+    B.SetInsertPoint(Body);
+    Value *Inv = B.CreateMul(A, B.getInt64(d + 3));
+    Value *Scaled = B.CreateMul(IV, B.getInt64(8));
+    Acc = B.CreateAdd(B.CreateAdd(AccPN, Inv), Scaled);
+
+    Levels.push_back({Header, Exit, IV, AccPN});
+    Pred = Body;
+  }
+
+  // close the loops from the inside out
+  for (auto it = Levels.rbegin(); it != Levels.rend(); ++it) {
+    Value *Next = B.CreateAdd(it->IV, B.getInt64(1));
+    it->IV->addIncoming(Next, B.GetInsertBlock());
+    it->Acc->addIncoming(Acc, B.GetInsertBlock());
+    B.CreateBr(it->Header);
+    B.SetInsertPoint(it->Exit);
+    Acc = it->Acc;
+  }
+  B.CreateRet(Acc);
+}
+
+/*
+ * C-- programs of the same shapes, written to disk for the front end
+ */
+
+static std::string _CmmStraightLine(unsigned Size)
+{
+  std::string S = "int f(int a, int b, int c) {\n  int x;\n  int y;\n  x = 0;\n  y = 0;\n";
+  for (unsigned i = 0; i < Size / 4; i++)
+    S += i % 2 ? "  x = x + a * b - c;\n" : "  y = y ^ (a * b - c);\n";
+  return S + "  return x + y;\n}\n";
+}
+
+static std::string _CmmDeepDominatorTree(unsigned Size)
+{
+  std::string S = "int f(int a, int b, int c) {\n  int x;\n  x = c;\n";
+  for (unsigned i = 0; i < Size / 8; i++)
+    S += "  if (x < a + b) { x = x * (a + b); } else { x = x + 1; }\n";
+  return S + "  return x;\n}\n";
+}
+
+static std::string _CmmWideBranch(unsigned Size)
+{
+  // C-- has no working switch; a flat run of ifs on one value is closest
+  std::string S = "int f(int a, int b, int c) {\n  int x;\n  x = 0;\n";
+  for (unsigned i = 0; i < Size / 8; i++)
+    S += "  if (a == " + std::to_string(i) + ") { x = a * b + " + std::to_string(i) +
+         "; } else { ; }\n";
+  return S + "  return x;\n}\n";
+}
+
+static std::string _CmmDeepLoopNest(unsigned Size)
+{
+  // bison's parser stack bounds the nesting, so nests of four repeat
+  std::string S = "int f(int a, int b, int c) {\n  int i;\n  int j;\n  int k;\n  int l;\n"
+                  "  int s;\n  s = 0;\n";
+  for (unsigned n = 0; n < std::max(Size / 40, 1u); n++)
+    S += "  i = 0;\n  while (i < b) {\n    j = 0;\n    while (j < 2) {\n"
+         "      k = 0;\n      while (k < 2) {\n        l = 0;\n        while (l < 2) {\n"
+         "          s = s + a * 3 + l * 8;\n          l = l + 1;\n        }\n"
+         "        k = k + 1;\n      }\n      j = j + 1;\n    }\n    i = i + 1;\n  }\n";
+  return S + "  return s;\n}\n";
+}
+
+/*
+ * Timing
+ */
+
+struct Shape {
+  const char *Name;
+  void (*Generate)(Module&, unsigned);
+  std::string (*Cmm)(unsigned);
+};
+
+static const Shape Shapes[] = {
+  { "straight", _GenerateStraightLine,      _CmmStraightLine      },
+  { "deepdom",  _GenerateDeepDominatorTree, _CmmDeepDominatorTree },
+  { "wide",     _GenerateWideBranch,        _CmmWideBranch        },
+  { "loops",    _GenerateDeepLoopNest,      _CmmDeepLoopNest      },
+};
+
+/* Dominance queries a pass would typically make on every block */
+static void _QueryDominance(Module &M)
+{
+  for (Function &F : M) {
+    if (F.isDeclaration())
+      continue;
+
+    std::vector<BasicBlock*> Blocks;
+    _WalkDominatorTree(F, [&](BasicBlock &BB) { Blocks.push_back(&BB); },
+                       [](BasicBlock &) {});
+
+    // a fixed pseudo-random sample of pairs, linear in the block count
+    uint64_t Seed = 1;
+    volatile unsigned Dominated = 0;
+    for (size_t i = 0; i < Blocks.size() * 8; i++) {
+      Seed = Seed * 6364136223846793005ULL + 1442695040888963407ULL;
+      BasicBlock *A = Blocks[(Seed >> 33) % Blocks.size()];
+      BasicBlock *B = Blocks[(Seed >> 17) % Blocks.size()];
+      Dominated += LLVMDominates(wrap(&F), wrap(A), wrap(B));
+    }
+
+    unsigned Count;
+    for (BasicBlock *BB : Blocks) {
+      LLVMDominanceFrontierLocal(wrap(BB), &Count);
+      LLVMDominanceFrontierClosure(wrap(BB), &Count);
+    }
+    GetLoopInfo(&F);
+  }
+}
+
+struct Operation {
+  const char *Name;
+  void (*Run)(Module&);
+};
+
+static const Operation Operations[] = {
+  { "cse",       RunCommonSubExpressionElimination },
+  { "dce",       RunDeadCodeElimination            },
+  { "constfold", RunConstantFolding                },
+  { "dominance", _QueryDominance                   },
+};
+
+static size_t _InstructionCount(Module &M)
+{
+  size_t Count = 0;
+  for (Function &F : M)
+    Count += F.getInstructionCount();
+  return Count;
+}
+
+/* What one size measured; filled in by a forked child */
+struct Measurement {
+  double Seconds;
+  size_t Insts;
+  double PeakRSS;     // megabytes, of the child alone
+};
+
+static void _Measure(const Shape &S, const Operation &Op, unsigned Size,
+                     Measurement &Result)
+{
+  // small inputs run in microseconds, so keep the best of several runs
+  double Seconds = 0, Total = 0;
+  size_t Insts = 0;
+  for (unsigned Run = 0; Run < 100 && (Run < 3 || Total < 0.05); Run++) {
+    LLVMContext Context;
+    Module M("bench", Context);
+    S.Generate(M, Size);
+    Insts = _InstructionCount(M);
+
+    auto Start = std::chrono::steady_clock::now();
+    Op.Run(M);
+    std::chrono::duration<double> Elapsed = std::chrono::steady_clock::now() - Start;
+    LLVMClearDominanceCache();
+
+    Seconds = Run == 0 ? Elapsed.count() : std::min(Seconds, Elapsed.count());
+    Total += Elapsed.count();
+  }
+  Result.Seconds = Seconds;
+  Result.Insts = Insts;
+}
+
+/* ru_maxrss is a high-water mark for the whole process, so each size is
+   run in a child and its peak read back with wait4 */
+static void _MeasureInChild(const Shape &S, const Operation &Op, unsigned Size,
+                            Measurement &Result)
+{
+  int Pipe[2];
+  if (pipe(Pipe) != 0) {
+    perror("bench: pipe");
+    exit(1);
+  }
+  fflush(stdout);
+
+  pid_t Child = fork();
+  if (Child < 0) {
+    perror("bench: fork");
+    exit(1);
+  }
+  if (Child == 0) {
+    close(Pipe[0]);
+    _Measure(S, Op, Size, Result);
+    bool Written = write(Pipe[1], &Result, sizeof(Result)) == sizeof(Result);
+    _exit(Written ? 0 : 1);
+  }
+
+  close(Pipe[1]);
+  bool Read = read(Pipe[0], &Result, sizeof(Result)) == sizeof(Result);
+  close(Pipe[0]);
+
+  int Status;
+  struct rusage Usage;
+  if (wait4(Child, &Status, 0, &Usage) != Child || !Read ||
+      !WIFEXITED(Status) || WEXITSTATUS(Status) != 0) {
+    fprintf(stderr, "bench: %s %s at size %u did not finish\n", S.Name, Op.Name, Size);
+    exit(1);
+  }
+  Result.PeakRSS = Usage.ru_maxrss / 1024.0;   // kilobytes on Linux
+}
+
+static void _EmitCmm(const char *Dir, unsigned MaxSize)
+{
+  for (const Shape &S : Shapes)
+    for (unsigned Size = 1024; Size <= MaxSize; Size *= 2) {
+      std::string Path = std::string(Dir) + "/" + S.Name + "_" + std::to_string(Size) + ".cmm";
+      FILE *Out = fopen(Path.c_str(), "w");
+      if (Out == NULL) {
+        fprintf(stderr, "bench: cannot write %s\n", Path.c_str());
+        exit(1);
+      }
+      fputs(S.Cmm(Size).c_str(), Out);
+      fclose(Out);
+    }
+}
+
+int main(int argc, char **argv)
+{
+  unsigned MaxSize = 65536;
+  bool CSV = false;
+  const char *CmmDir = NULL;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--max") && i + 1 < argc)
+      MaxSize = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--csv"))
+      CSV = true;
+    else if (!strcmp(argv[i], "--emit-cmm") && i + 1 < argc)
+      CmmDir = argv[++i];
+    else {
+      fprintf(stderr, "usage: %s [--max N] [--csv] [--emit-cmm DIR]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  if (CmmDir)
+    _EmitCmm(CmmDir, MaxSize);
+
+  if (CSV)
+    printf("shape,op,size,instructions,seconds,inst_per_sec,scaling,peak_rss_mb\n");
+  else
+    printf("%-9s %-10s %8s %10s %10s %12s %8s %9s\n", "shape", "op", "size",
+           "insts", "seconds", "inst/s", "scaling", "rss(MB)");
+
+  for (const Shape &S : Shapes)
+    for (const Operation &Op : Operations) {
+      double PrevPerInst = 0;
+      for (unsigned Size = 1024; Size <= MaxSize; Size *= 2) {
+        Measurement Result;
+        _MeasureInChild(S, Op, Size, Result);
+        double Seconds = Result.Seconds;
+        size_t Insts = Result.Insts;
+
+        // time per instruction relative to the previous size
+        double PerInst = Seconds / Insts;
+        double Scaling = PrevPerInst > 0 ? PerInst / PrevPerInst : 1.0;
+        PrevPerInst = PerInst;
+
+        if (CSV)
+          printf("%s,%s,%u,%zu,%.6f,%.0f,%.2f,%.1f\n", S.Name, Op.Name, Size, Insts,
+                 Seconds, Insts / Seconds, Scaling, Result.PeakRSS);
+        else
+          printf("%-9s %-10s %8u %10zu %10.6f %12.0f %8.2f %9.1f%s\n", S.Name, Op.Name,
+                 Size, Insts, Seconds, Insts / Seconds, Scaling, Result.PeakRSS,
+                 Scaling > 1.6 ? "  superlinear" : "");
+      }
+    }
+  return 0;
+}
@@ -0,0 +1,425 @@
+/*
+ * File: cache.cpp
+ *
+ * Description:
+ *   Incremental optimization.  Every defined function is copied into a
+ *   module of its own that declares only the globals the function refers
+ *   to, and the SHA-1 hash of that module's bitcode, together with the
+ *   identity of the optimizer binary, keys the function in an on-disk
+ *   cache.  A function found there gets back the optimized body and the
+ *   counters recorded when it was first optimized.  The others are
+ *   optimized on their own modules the way the parallel driver optimizes
+ *   its partitions, and are added to the cache for the next run.
+ *
+ *   An entry is one file named after the key: a line with the counters,
+ *   followed by the optimized module as bitcode.
+ */
+
+/* LLVM Header Files */
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Value.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Metadata.h"
+#include "llvm/IR/DebugInfoMetadata.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/SHA1.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include <dlfcn.h>
+#include <stdio.h>
+#include <vector>
+#include "dominance.h"
+
+using namespace llvm;
+#include "CSE.h"
+
+namespace {
+
+/* One defined function, the globals it refers to in the order they are
+   declared in its module, and its bitcode before and after optimizing */
+struct CacheUnit {
+  Function *F;
+  std::vector<GlobalVariable*> Variables;
+  std::vector<Function*> Functions;     // F itself first
+  SmallVector<char, 0> Input;
+  SmallVector<char, 0> Output;
+  std::string Path;
+  CSEStatistics Stats;
+};
+
+} // end anonymous namespace
+
+/* The counters an entry records; a change here needs a new magic */
+static const char CacheMagic[] = "CSE1";
+static int CSEStatistics::*const CachedCounters[] = {
+  &CSEStatistics::Dead, &CSEStatistics::Elim, &CSEStatistics::Simplify,
+  &CSEStatistics::LdElim, &CSEStatistics::LdStElim, &CSEStatistics::RStElim,
+  &CSEStatistics::Unreach, &CSEStatistics::Strength, &CSEStatistics::Promoted,
+  &CSEStatistics::Licm, &CSEStatistics::IndVars,
+};
+
+/* Entries are only valid for the code that produced them.  Null, after
+   saying why once, if the binary holding the optimizer cannot be told
+   apart from another build of it. */
+static const std::string *_OptimizerIdentity()
+{
+  static const std::string Identity = []() -> std::string {
+    Dl_info Info;
+    if (!dladdr((void*)&RunPipelineWithCache, &Info) || Info.dli_fname == NULL) {
+      fprintf(stderr, "CSE: not caching: cannot find the file the optimizer was loaded from\n");
+      return "";
+    }
+    sys::fs::file_status Status;
+    if (std::error_code EC = sys::fs::status(Info.dli_fname, Status)) {
+      fprintf(stderr, "CSE: not caching: cannot stat %s: %s\n", Info.dli_fname,
+              EC.message().c_str());
+      return "";
+    }
+    return std::string(CacheMagic) + " " + Info.dli_fname + " " +
+           std::to_string(Status.getSize()) + " " +
+           std::to_string(Status.getLastModificationTime().time_since_epoch().count());
+  }();
+  return Identity.empty() ? nullptr : &Identity;
+}
+
+static bool _MetadataRefersToGlobals(Metadata *MD, DenseSet<Metadata*> &Visited)
+{
+  if (!Visited.insert(MD).second)
+    return false;
+  if (ConstantAsMetadata *C = dyn_cast<ConstantAsMetadata>(MD))
+    return !isa<ConstantData>(C->getValue());
+  if (MDNode *N = dyn_cast<MDNode>(MD))
+    for (const MDOperand &Op : N->operands())
+      if (Op && _MetadataRefersToGlobals(Op, Visited))
+        return true;
+  return false;
+}
+
+/*
+ * Metadata attached to a function or instruction is cloned along with
+ * it, and the module flags are copied, so a global they mention would
+ * have to be declared too.  That is rare enough that such modules are
+ * simply not cached.
+ */
+static bool _MetadataReferToGlobals(Module &M)
+{
+  DenseSet<Metadata*> Visited;
+  if (NamedMDNode *Flags = M.getModuleFlagsMetadata())
+    for (MDNode *Flag : Flags->operands())
+      if (_MetadataRefersToGlobals(Flag, Visited))
+        return true;
+
+  SmallVector<std::pair<unsigned, MDNode*>, 4> Attachments;
+  auto Check = [&]() {
+    for (auto &A : Attachments)
+      if (_MetadataRefersToGlobals(A.second, Visited))
+        return true;
+    return false;
+  };
+
+  for (Function &F : M) {
+    F.getAllMetadata(Attachments);
+    if (Check())
+      return true;
+    for (BasicBlock &BB : F)
+      for (Instruction &I : BB) {
+        I.getAllMetadata(Attachments);
+        if (Check())
+          return true;
+      }
+  }
+  return false;
+}
+
+/* Adds the globals V refers to; false if one cannot be declared alone */
+static bool _CollectGlobals(Value *V, CacheUnit &U, SmallPtrSetImpl<Value*> &Visited)
+{
+  if (!Visited.insert(V).second)
+    return true;
+
+  if (isa<BlockAddress>(V) || isa<GlobalAlias>(V) || isa<GlobalIFunc>(V))
+    return false;
+  if (GlobalVariable *GV = dyn_cast<GlobalVariable>(V)) {
+    U.Variables.push_back(GV);
+    return true;
+  }
+  if (Function *F = dyn_cast<Function>(V)) {
+    if (F != U.F)
+      U.Functions.push_back(F);
+    return true;
+  }
+
+  if (MetadataAsValue *MAV = dyn_cast<MetadataAsValue>(V)) {
+    Metadata *MD = MAV->getMetadata();
+    if (ValueAsMetadata *VAM = dyn_cast<ValueAsMetadata>(MD))
+      return _CollectGlobals(VAM->getValue(), U, Visited);
+    if (DIArgList *Args = dyn_cast<DIArgList>(MD))
+      for (ValueAsMetadata *VAM : Args->getArgs())
+        if (!_CollectGlobals(VAM->getValue(), U, Visited))
+          return false;
+    DenseSet<Metadata*> Seen;
+    return !isa<MDNode>(MD) || !_MetadataRefersToGlobals(MD, Seen);
+  }
+
+  if (Constant *C = dyn_cast<Constant>(V))
+    for (Value *Op : C->operands())
+      if (!_CollectGlobals(Op, U, Visited))
+        return false;
+  return true;
+}
+
+static bool _CollectUnit(Function &F, CacheUnit &U)
+{
+  SmallPtrSet<Value*, 32> Visited;
+  U.F = &F;
+  U.Functions.push_back(&F);
+  Visited.insert(&F);
+
+  if (F.hasPersonalityFn() && !_CollectGlobals(F.getPersonalityFn(), U, Visited))
+    return false;
+  if (F.hasPrefixData() && !_CollectGlobals(F.getPrefixData(), U, Visited))
+    return false;
+  if (F.hasPrologueData() && !_CollectGlobals(F.getPrologueData(), U, Visited))
+    return false;
+
+  for (BasicBlock &BB : F)
+    for (Instruction &I : BB)
+      for (Value *Op : I.operands())
+        if (!isa<Instruction>(Op) && !isa<Argument>(Op) && !isa<BasicBlock>(Op) &&
+            !_CollectGlobals(Op, U, Visited))
+          return false;
+  return true;
+}
+
+static GlobalValue::LinkageTypes _DeclarationLinkage(GlobalValue *GV)
+{
+  return GV->hasExternalWeakLinkage() ? GlobalValue::ExternalWeakLinkage
+                                      : GlobalValue::ExternalLinkage;
+}
+
+/* Writes F, alone with declarations of what it refers to, as bitcode */
+static void _IsolateFunction(Module &M, CacheUnit &U)
+{
+  Module Part("cache", M.getContext());
+  Part.setSourceFileName("cache");
+  Part.setDataLayout(M.getDataLayout());
+  Part.setTargetTriple(M.getTargetTriple());
+  if (NamedMDNode *Flags = M.getModuleFlagsMetadata())
+    for (MDNode *Flag : Flags->operands())
+      Part.getOrInsertModuleFlagsMetadata()->addOperand(Flag);
+
+  ValueToValueMapTy VMap;
+  for (GlobalVariable *GV : U.Variables) {
+    GlobalVariable *Decl = new GlobalVariable(Part, GV->getValueType(), GV->isConstant(),
+                                              _DeclarationLinkage(GV), nullptr,
+                                              GV->getName(), nullptr,
+                                              GV->getThreadLocalMode(),
+                                              GV->getAddressSpace());
+    Decl->copyAttributesFrom(GV);
+    VMap[GV] = Decl;
+  }
+  for (Function *F : U.Functions) {
+    Function *Decl = Function::Create(F->getFunctionType(),
+                                      F == U.F ? F->getLinkage() : _DeclarationLinkage(F),
+                                      F->getAddressSpace(), F->getName(), &Part);
+    Decl->setCallingConv(F->getCallingConv());
+    Decl->setAttributes(F->getAttributes());
+    VMap[F] = Decl;
+  }
+
+  Function *Clone = cast<Function>(VMap[U.F]);
+  auto CloneArg = Clone->arg_begin();
+  for (Argument &A : U.F->args()) {
+    CloneArg->setName(A.getName());
+    VMap[&A] = &*CloneArg++;
+  }
+  SmallVector<ReturnInst*, 8> Returns;
+  CloneFunctionInto(Clone, U.F, VMap, CloneFunctionChangeType::DifferentModule, Returns);
+
+  // an empty list would be dropped with a warning when it is read
+  NamedMDNode *CompileUnits = Part.getNamedMetadata("llvm.dbg.cu");
+  if (CompileUnits && CompileUnits->getNumOperands() == 0)
+    Part.eraseNamedMetadata(CompileUnits);
+
+  // the constants' use lists span all of M, so keeping their order would
+  // cost time in the size of M for every function
+  _WriteBitcode(Part, U.Input, /*PreserveUseListOrder=*/false);
+}
+
+static std::string _CacheKey(const CacheUnit &U, const std::string &Identity)
+{
+  SHA1 Hash;
+  Hash.update(Identity);
+  Hash.update(StringRef(U.Input.data(), U.Input.size()));
+  return toHex(Hash.final(), /*LowerCase=*/true);
+}
+
+static bool _ReadEntry(CacheUnit &U)
+{
+  ErrorOr<std::unique_ptr<MemoryBuffer>> Buffer = MemoryBuffer::getFile(U.Path);
+  if (!Buffer)
+    return false;
+
+  std::pair<StringRef, StringRef> Entry = (*Buffer)->getBuffer().split('\n');
+  SmallVector<StringRef, 16> Fields;
+  Entry.first.split(Fields, ' ');
+  if (Fields.size() != 1 + array_lengthof(CachedCounters) || Fields[0] != CacheMagic)
+    return false;
+
+  for (unsigned i = 0; i < array_lengthof(CachedCounters); i++)
+    if (Fields[i + 1].getAsInteger(10, U.Stats.*CachedCounters[i]))
+      return false;
+  U.Output.assign(Entry.second.begin(), Entry.second.end());
+  return true;
+}
+
+static void _WriteEntry(const CacheUnit &U, bool &Warned)
+{
+  // written aside and renamed, so a concurrent run never sees half of it
+  Expected<sys::fs::TempFile> Temp = sys::fs::TempFile::create(U.Path + ".%%%%%%.tmp");
+  if (Temp) {
+    raw_fd_ostream OS(Temp->FD, /*shouldClose=*/false);
+    OS << CacheMagic;
+    for (int CSEStatistics::*Counter : CachedCounters)
+      OS << ' ' << U.Stats.*Counter;
+    OS << '\n';
+    OS.write(U.Output.data(), U.Output.size());
+    OS.flush();
+
+    Error E = OS.has_error() ? Temp->discard() : Temp->keep(U.Path);
+    if (!E && !OS.has_error())
+      return;
+    consumeError(std::move(E));
+    OS.clear_error();
+  } else {
+    consumeError(Temp.takeError());
+  }
+
+  if (!Warned)
+    fprintf(stderr, "CSE: cannot write cache entry %s\n", U.Path.c_str());
+  Warned = true;
+}
+
+/*
+ * Moves the optimized body in U.Output into U.F.  The optimized module
+ * declares the same globals in the same order as the one it was made
+ * from, followed by any declaration a pass added; false if it does not.
+ */
+static bool _ReadBack(Module &M, CacheUnit &U)
+{
+  MemoryBufferRef Buffer(StringRef(U.Output.data(), U.Output.size()), U.Path);
+  Expected<std::unique_ptr<Module>> Part = parseBitcodeFile(Buffer, M.getContext());
+  if (!Part) {
+    consumeError(Part.takeError());
+    return false;
+  }
+
+  ValueToValueMapTy VMap;
+  auto GV = (*Part)->global_begin();
+  for (GlobalVariable *Var : U.Variables) {
+    if (GV == (*Part)->global_end() || GV->getValueType() != Var->getValueType())
+      return false;
+    VMap[&*GV++] = Var;
+  }
+  if (GV != (*Part)->global_end())
+    return false;
+
+  auto F = (*Part)->begin();
+  for (Function *Fn : U.Functions) {
+    if (F == (*Part)->end() || F->getFunctionType() != Fn->getFunctionType())
+      return false;
+    VMap[&*F++] = Fn;
+  }
+  for (; F != (*Part)->end(); ++F)
+    VMap[&*F] = M.getOrInsertFunction(F->getName(), F->getFunctionType(),
+                                      F->getAttributes()).getCallee();
+
+  Function *Src = &*(*Part)->begin();
+  if (Src->isDeclaration())
+    return false;
+  _ReplaceFunctionBody(U.F, Src, VMap);
+  return true;
+}
+
+bool RunPipelineWithCache(Module &M, const char *Directory, unsigned Threads,
+                          function_ref<void(Module&)> Pipeline)
+{
+  // named struct types would be renamed when parsed back into M's context
+  if (!M.getIdentifiedStructTypes().empty() || _MetadataReferToGlobals(M))
+    return false;
+
+  const std::string *Identity = _OptimizerIdentity();
+  if (Identity == nullptr)
+    return false;
+
+  if (std::error_code EC = sys::fs::create_directories(Directory)) {
+    fprintf(stderr, "CSE: cannot create cache directory %s: %s\n", Directory,
+            EC.message().c_str());
+    return false;
+  }
+
+  std::vector<CacheUnit> Units;
+  for (Function &F : M) {
+    if (F.isDeclaration())
+      continue;
+    Units.emplace_back();
+    if (!_CollectUnit(F, Units.back()))
+      return false;
+  }
+
+  // every key is taken before any body changes
+  for (CacheUnit &U : Units) {
+    _IsolateFunction(M, U);
+    U.Path = (Twine(Directory) + "/" + _CacheKey(U, *Identity) + ".bc").str();
+  }
+
+  bool HadCompileUnits = M.getNamedMetadata("llvm.dbg.cu") != nullptr;
+  std::vector<CacheUnit*> Misses;
+  for (CacheUnit &U : Units) {
+    if (_ReadEntry(U) && _ReadBack(M, U)) {
+      CSEStats += U.Stats;
+      CSEStats.CacheHits++;
+    } else {
+      U.Stats = CSEStatistics();
+      U.Output.clear();
+      Misses.push_back(&U);
+    }
+  }
+
+  // M's context is only ever touched from this thread
+  if (Threads > 1 && Misses.size() > 1) {
+    ThreadPool Pool(hardware_concurrency(std::min<size_t>(Threads, Misses.size())));
+    for (CacheUnit *U : Misses)
+      Pool.async([U, Pipeline]() { U->Stats = _OptimizeBitcode(U->Input, U->Output, Pipeline); });
+    Pool.wait();
+  } else {
+    for (CacheUnit *U : Misses)
+      U->Stats = _OptimizeBitcode(U->Input, U->Output, Pipeline);
+  }
+
+  bool Warned = false;
+  for (CacheUnit *U : Misses) {
+    // a body that does not fit back is left as it was, unoptimized
+    if (!_ReadBack(M, *U))
+      continue;
+    _WriteEntry(*U, Warned);
+    CSEStats += U->Stats;
+    CSEStats.CacheMisses++;
+  }
+
+  // cloning across modules creates the list even when there is no debug info
+  NamedMDNode *CompileUnits = M.getNamedMetadata("llvm.dbg.cu");
+  if (!HadCompileUnits && CompileUnits && CompileUnits->getNumOperands() == 0)
+    M.eraseNamedMetadata(CompileUnits);
+  return true;
+}
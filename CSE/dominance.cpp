@@ -21,143 +21,503 @@
 //#include "llvm/Analysis/PostDominators.h"
 #include "llvm/Analysis/LoopInfo.h"
 #include "llvm/IR/Type.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/ADT/BitVector.h"
+#include <memory>
 
 #include "dominance.h"
 
 using namespace llvm;
 
-Function *Current=NULL;
-DominatorTreeBase<BasicBlock,false> *DT=NULL;
-DominatorTreeBase<BasicBlock,true> *PDT=NULL;
+/*
+ * Analyses are computed lazily, one at a time, and cached per function.
+ * Every function has an epoch that LLVMInvalidateDominance bumps when its
+ * CFG changes; a cached analysis is only used while the epoch it was
+ * computed in is still current.  Each thread keeps its own cache so
+ * functions in different modules can be optimized concurrently.
+ */
+namespace {
+
+/*
+ * A flat copy of the dominator tree.  Nodes are numbered in preorder, so
+ * a node's subtree is the range [In, Out] and dominance is two compares.
+ * The children of node i are Children[ChildBegin[i] .. ChildBegin[i+1]),
+ * and Position maps a node back to its slot in its parent's range.
+ */
+struct DomTreeLayout {
+  DenseMap<const BasicBlock*, unsigned> Number;
+  std::vector<unsigned> In;
+  std::vector<unsigned> Out;
+  std::vector<unsigned> ChildBegin;
+  std::vector<unsigned> Position;
+  std::vector<LLVMBasicBlockRef> Children;
+};
+
+/* An iterated frontier handed out by LLVM*FrontierClosure */
+struct BlockClosure {
+  std::unique_ptr<LLVMBasicBlockRef[]> Blocks;
+  unsigned Count = 0;
+};
+
+/*
+ * Dominance frontiers in compressed rows: the frontier of the block
+ * numbered i is Blocks[Begin[i] .. Begin[i+1]).  Blocks are numbered in
+ * function order.  Iterated frontiers of single blocks are computed when
+ * first asked for, each into an allocation of its own that lives as long
+ * as the table, so earlier closures stay put while later ones are added.
+ */
+struct FrontierTable {
+  DenseMap<const BasicBlock*, unsigned> Number;
+  std::vector<BasicBlock*> Block;
+  std::vector<unsigned> Begin;
+  std::vector<LLVMBasicBlockRef> Blocks;
+  DenseMap<const BasicBlock*, BlockClosure> Closures;
+};
+
+struct FunctionAnalyses {
+  unsigned Epoch = 1;
+  unsigned DTEpoch = 0;
+  unsigned PDTEpoch = 0;
+  unsigned LIEpoch = 0;
+  unsigned LayoutEpoch = 0;
+  unsigned DFEpoch = 0;
+  unsigned PDFEpoch = 0;
+  DominatorTreeBase<BasicBlock,false> DT;
+  DominatorTreeBase<BasicBlock,true> PDT;
+  LoopInfoBase<BasicBlock,Loop> LI;
+  DomTreeLayout Layout;
+  FrontierTable DF;
+  FrontierTable PDF;
+};
+
+} // end anonymous namespace
+
+thread_local DenseMap<Function*, std::unique_ptr<FunctionAnalyses>> Analyses;
+thread_local AnalysisCounts Counts;
+
+const AnalysisCounts &GetAnalysisCounts()
+{
+  return Counts;
+}
+
+static FunctionAnalyses &GetAnalyses(Function *F)
+{
+  std::unique_ptr<FunctionAnalyses> &A = Analyses[F];
+  if (!A)
+    A.reset(new FunctionAnalyses());
+  return *A;
+}
+
+DominatorTreeBase<BasicBlock,false> &GetDominatorTree(Function *F)
+{
+  FunctionAnalyses &A = GetAnalyses(F);
+  if (A.DTEpoch != A.Epoch)
+    {
+      A.DT.recalculate(*F);
+      Counts.DT++;
+      A.DTEpoch = A.Epoch;
+    }
+  return A.DT;
+}
+
+DominatorTreeBase<BasicBlock,true> &GetPostDominatorTree(Function *F)
+{
+  FunctionAnalyses &A = GetAnalyses(F);
+  if (A.PDTEpoch != A.Epoch)
+    {
+      A.PDT.recalculate(*F);
+      Counts.PDT++;
+      A.PDTEpoch = A.Epoch;
+    }
+  return A.PDT;
+}
+
+LoopInfoBase<BasicBlock,Loop> &GetLoopInfo(Function *F)
+{
+  FunctionAnalyses &A = GetAnalyses(F);
+  if (A.LIEpoch != A.Epoch)
+    {
+      DominatorTreeBase<BasicBlock,false> &DT = GetDominatorTree(F);
+      A.LI.releaseMemory();
+      A.LI.analyze(DT);
+      Counts.LI++;
+      A.LIEpoch = A.Epoch;
+    }
+  return A.LI;
+}
+
+static void BuildLayout(DominatorTreeBase<BasicBlock,false> &DT, DomTreeLayout &L)
+{
+  L.Number.clear();
+  L.In.clear();
+  L.Out.clear();
+  L.ChildBegin.clear();
+  L.Position.clear();
+  L.Children.clear();
+
+  DomTreeNodeBase<BasicBlock> *Root = DT.getRootNode();
+  if (Root == NULL)
+    return;
+
+  std::vector<DomTreeNodeBase<BasicBlock>*> Stack(1, Root);
+  std::vector<DomTreeNodeBase<BasicBlock>*> Preorder;
+  while (!Stack.empty())
+    {
+      DomTreeNodeBase<BasicBlock> *Node = Stack.back();
+      Stack.pop_back();
+      Preorder.push_back(Node);
+
+      // push in reverse so the first child is visited first
+      for (auto it = Node->end(); it != Node->begin(); )
+        Stack.push_back(*--it);
+    }
+
+  unsigned N = Preorder.size();
+  L.In.assign(N, 0);
+  L.Out.assign(N, 0);
+  L.Position.assign(N, 0);
+  L.ChildBegin.assign(N + 1, 0);
+  L.Children.reserve(N);
+
+  for (unsigned i = 0; i < N; i++)
+    {
+      L.Number[Preorder[i]->getBlock()] = i;
+      L.In[i] = i;
+    }
+
+  for (unsigned i = 0; i < N; i++)
+    {
+      L.ChildBegin[i] = L.Children.size();
+      for (DomTreeNodeBase<BasicBlock> *Child : *Preorder[i])
+        {
+          L.Position[L.Number[Child->getBlock()]] = L.Children.size();
+          L.Children.push_back(wrap(Child->getBlock()));
+        }
+    }
+  L.ChildBegin[N] = L.Children.size();
+
+  // a subtree ends where the subtree of its last child ends
+  for (unsigned i = N; i-- > 0; )
+    {
+      unsigned Last = i;
+      unsigned End = L.ChildBegin[i + 1];
+      if (End != L.ChildBegin[i])
+        Last = L.Out[L.Number[unwrap(L.Children[End - 1])]];
+      L.Out[i] = Last;
+    }
+}
+
+static DomTreeLayout &GetDomTreeLayout(Function *F)
+{
+  FunctionAnalyses &A = GetAnalyses(F);
+  if (A.LayoutEpoch != A.Epoch)
+    {
+      BuildLayout(GetDominatorTree(F), A.Layout);
+      Counts.Layout++;
+      A.LayoutEpoch = A.Epoch;
+    }
+  return A.Layout;
+}
+
+/*
+ * Cooper, Harvey and Kennedy: a block is in the frontier of every block
+ * on the tree path from each of its incoming edges up to, but excluding,
+ * its immediate dominator.  The path is empty unless the block is a join
+ * point or, in a post-dominator tree, a root standing in for an exit in
+ * an infinite loop.  For the post-dominance frontier the same walk runs
+ * on the reversed CFG.
+ */
+template <bool IsPostDom>
+static void BuildFrontier(Function &F, DominatorTreeBase<BasicBlock,IsPostDom> &DT,
+                          FrontierTable &T)
+{
+  T.Number.clear();
+  T.Block.clear();
+  T.Begin.clear();
+  T.Blocks.clear();
+  T.Closures.clear();
 
-LoopInfoBase<BasicBlock,Loop> *LI=NULL;
+  for (BasicBlock &BB : F)
+    {
+      T.Number[&BB] = T.Block.size();
+      T.Block.push_back(&BB);
+    }
+
+  unsigned N = T.Block.size();
+  std::vector<std::pair<unsigned, BasicBlock*>> Entries;
+  std::vector<BasicBlock*> LastJoin(N, nullptr);
+  SmallVector<BasicBlock*, 8> Incoming;
+
+  for (BasicBlock &BB : F)
+    {
+      DomTreeNodeBase<BasicBlock> *Node = DT.getNode(&BB);
+      if (Node == NULL)
+        continue;
+
+      Incoming.clear();
+      if (IsPostDom)
+        Incoming.append(succ_begin(&BB), succ_end(&BB));
+      else
+        Incoming.append(pred_begin(&BB), pred_end(&BB));
+
+      DomTreeNodeBase<BasicBlock> *IDom = Node->getIDom();
+      for (BasicBlock *In : Incoming)
+        {
+          // walks up to the virtual root of a post-dominator tree end at NULL
+          for (DomTreeNodeBase<BasicBlock> *Runner = DT.getNode(In);
+               Runner != NULL && Runner != IDom && Runner->getBlock() != NULL;
+               Runner = Runner->getIDom())
+            {
+              unsigned R = T.Number[Runner->getBlock()];
+              if (LastJoin[R] == &BB)
+                break;  // this path was already walked for BB
+              LastJoin[R] = &BB;
+              Entries.push_back(std::make_pair(R, &BB));
+            }
+        }
+    }
+
+  // counting sort into rows
+  T.Begin.assign(N + 1, 0);
+  for (auto &E : Entries)
+    T.Begin[E.first + 1]++;
+  for (unsigned i = 0; i < N; i++)
+    T.Begin[i + 1] += T.Begin[i];
+
+  std::vector<unsigned> Fill(T.Begin.begin(), T.Begin.end() - 1);
+  T.Blocks.resize(Entries.size());
+  for (auto &E : Entries)
+    T.Blocks[Fill[E.first]++] = wrap(E.second);
+}
 
-void UpdateDominators(Function *F)
+static FrontierTable &GetDominanceFrontier(Function *F)
 {
-  if (Current != F)
+  FunctionAnalyses &A = GetAnalyses(F);
+  if (A.DFEpoch != A.Epoch)
     {
-      Current = F;
-
-      if (DT==NULL)
-	{
-	  DT = new DominatorTreeBase<BasicBlock,false>();
-	  PDT = new DominatorTreeBase<BasicBlock,true>();
-	  if (LI==NULL)
-	    LI = new LoopInfoBase<BasicBlock,Loop>();
-	}
-      
-      DT->recalculate(*F);
-      PDT->recalculate(*F);
-
-      LI->analyze(*DT);
+      BuildFrontier(*F, GetDominatorTree(F), A.DF);
+      Counts.DF++;
+      A.DFEpoch = A.Epoch;
     }
+  return A.DF;
+}
+
+static FrontierTable &GetPostDominanceFrontier(Function *F)
+{
+  FunctionAnalyses &A = GetAnalyses(F);
+  if (A.PDFEpoch != A.Epoch)
+    {
+      BuildFrontier(*F, GetPostDominatorTree(F), A.PDF);
+      Counts.PDF++;
+      A.PDFEpoch = A.Epoch;
+    }
+  return A.PDF;
+}
+
+static void IteratedFrontier(FrontierTable &T, ArrayRef<BasicBlock*> Blocks,
+                             SmallVectorImpl<BasicBlock*> &Result)
+{
+  BitVector InResult(T.Block.size());
+  SmallVector<unsigned, 32> Worklist;
+
+  for (BasicBlock *BB : Blocks)
+    {
+      auto It = T.Number.find(BB);
+      if (It != T.Number.end())
+        Worklist.push_back(It->second);
+    }
+
+  while (!Worklist.empty())
+    {
+      unsigned i = Worklist.pop_back_val();
+      for (unsigned j = T.Begin[i]; j < T.Begin[i + 1]; j++)
+        {
+          unsigned k = T.Number[unwrap(T.Blocks[j])];
+          if (InResult.test(k))
+            continue;
+          InResult.set(k);
+          Result.push_back(T.Block[k]);
+          Worklist.push_back(k);
+        }
+    }
+}
+
+void GetIteratedDominanceFrontier(Function *F, ArrayRef<BasicBlock*> Blocks,
+                                  SmallVectorImpl<BasicBlock*> &Result)
+{
+  IteratedFrontier(GetDominanceFrontier(F), Blocks, Result);
+}
+
+static const LLVMBasicBlockRef *FrontierLocal(FrontierTable &T, BasicBlock *BB,
+                                              unsigned *Count)
+{
+  auto It = T.Number.find(BB);
+  *Count = 0;
+  if (It == T.Number.end())
+    return NULL;
+
+  unsigned Begin = T.Begin[It->second];
+  *Count = T.Begin[It->second + 1] - Begin;
+  return T.Blocks.data() + Begin;
+}
+
+static const LLVMBasicBlockRef *FrontierClosure(FrontierTable &T, BasicBlock *BB,
+                                                unsigned *Count)
+{
+  BlockClosure &C = T.Closures[BB];
+  if (!C.Blocks)
+    {
+      SmallVector<BasicBlock*, 16> Closure;
+      IteratedFrontier(T, BB, Closure);
+
+      C.Blocks.reset(new LLVMBasicBlockRef[Closure.size()]);
+      C.Count = Closure.size();
+      for (unsigned i = 0; i < C.Count; i++)
+        C.Blocks[i] = wrap(Closure[i]);
+    }
+
+  *Count = C.Count;
+  return C.Blocks.get();
+}
+
+void LLVMInvalidateDominance(LLVMValueRef Fun)
+{
+  auto It = Analyses.find((Function*)unwrap(Fun));
+  if (It != Analyses.end())
+    It->second->Epoch++;
+}
+
+void LLVMClearDominanceCache(void)
+{
+  // cached functions may be freed and their addresses reused
+  Analyses.clear();
 }
 
 // Test if a dom b
 LLVMBool LLVMDominates(LLVMValueRef Fun, LLVMBasicBlockRef a, LLVMBasicBlockRef b)
 {
-  UpdateDominators((Function*)unwrap(Fun));
-  return DT->dominates(unwrap(a),unwrap(b));
+  if (a == b)
+    return true;
+
+  DomTreeLayout &L = GetDomTreeLayout((Function*)unwrap(Fun));
+  auto A = L.Number.find(unwrap(a));
+  auto B = L.Number.find(unwrap(b));
+
+  // like DominatorTree, anything dominates an unreachable block
+  if (B == L.Number.end())
+    return true;
+  if (A == L.Number.end())
+    return false;
+  return L.In[A->second] <= L.In[B->second] && L.Out[B->second] <= L.Out[A->second];
 }
 
 // Test if a pdom b
 LLVMBool LLVMPostDominates(LLVMValueRef Fun, LLVMBasicBlockRef a, LLVMBasicBlockRef b)
 {
-  UpdateDominators((Function*)unwrap(Fun));
-  return PDT->dominates(unwrap(a),unwrap(b));
+  return GetPostDominatorTree((Function*)unwrap(Fun)).dominates(unwrap(a),unwrap(b));
 }
 
 LLVMBool LLVMIsReachableFromEntry(LLVMValueRef Fun, LLVMBasicBlockRef bb) {
-  UpdateDominators((Function*)unwrap(Fun));
-  return DT->isReachableFromEntry(unwrap(bb));
+  return GetDominatorTree((Function*)unwrap(Fun)).isReachableFromEntry(unwrap(bb));
 }
 
 
 LLVMBasicBlockRef LLVMImmDom(LLVMBasicBlockRef BB)
 {
-  UpdateDominators(unwrap(BB)->getParent());
+  DominatorTreeBase<BasicBlock,false> &DT = GetDominatorTree(unwrap(BB)->getParent());
 
-  if ( DT->getNode((BasicBlock*)unwrap(BB)) == NULL )
+  if ( DT.getNode((BasicBlock*)unwrap(BB)) == NULL )
     return NULL;
   
-  if ( DT->getNode((BasicBlock*)unwrap(BB))->getIDom()==NULL )
+  if ( DT.getNode((BasicBlock*)unwrap(BB))->getIDom()==NULL )
     return NULL;
 
-  return wrap(DT->getNode(unwrap(BB))->getIDom()->getBlock());
+  return wrap(DT.getNode(unwrap(BB))->getIDom()->getBlock());
 }
 
 LLVMBasicBlockRef LLVMImmPostDom(LLVMBasicBlockRef BB)
 {
-  UpdateDominators(unwrap(BB)->getParent());
+  DominatorTreeBase<BasicBlock,true> &PDT = GetPostDominatorTree(unwrap(BB)->getParent());
 
-  if (PDT->getNode(unwrap(BB))->getIDom()==NULL)
+  if (PDT.getNode(unwrap(BB))->getIDom()==NULL)
     return NULL;
 
-  return wrap((BasicBlock*)PDT->getNode(unwrap(BB))->getIDom()->getBlock());
+  return wrap((BasicBlock*)PDT.getNode(unwrap(BB))->getIDom()->getBlock());
 }
 
-LLVMBasicBlockRef LLVMFirstDomChild(LLVMBasicBlockRef BB)
+const LLVMBasicBlockRef *LLVMGetDomChildren(LLVMBasicBlockRef BB, unsigned *Count)
 {
-  UpdateDominators(unwrap(BB)->getParent());
-  DomTreeNodeBase<BasicBlock> *Node = DT->getNode(unwrap(BB));
+  DomTreeLayout &L = GetDomTreeLayout(unwrap(BB)->getParent());
+  auto It = L.Number.find(unwrap(BB));
 
-  if(Node==NULL)
+  *Count = 0;
+  if (It == L.Number.end())
     return NULL;
 
-  DomTreeNodeBase<BasicBlock>::iterator it = Node->begin();
-  if (it!=Node->end())
-    return wrap((*it)->getBlock());
-  return NULL;
+  unsigned Begin = L.ChildBegin[It->second];
+  *Count = L.ChildBegin[It->second + 1] - Begin;
+  return L.Children.data() + Begin;
 }
 
-LLVMBasicBlockRef LLVMNextDomChild(LLVMBasicBlockRef BB, LLVMBasicBlockRef Child)
+LLVMBasicBlockRef LLVMFirstDomChild(LLVMBasicBlockRef BB)
 {
-  UpdateDominators(unwrap(BB)->getParent());
-  DomTreeNodeBase<BasicBlock> *Node = DT->getNode(unwrap(BB));
-  DomTreeNodeBase<BasicBlock>::iterator it,end;
+  unsigned Count;
+  const LLVMBasicBlockRef *Children = LLVMGetDomChildren(BB, &Count);
+  return Count ? Children[0] : NULL;
+}
 
-  bool next=false;
-  for(it=Node->begin(),end=Node->end(); it!=end; it++)
-    if (next)
-      return wrap((*it)->getBlock());
-    else if (*it==DT->getNode(unwrap(Child)))
-      next=true;
+LLVMBasicBlockRef LLVMNextDomChild(LLVMBasicBlockRef BB, LLVMBasicBlockRef Child)
+{
+  DomTreeLayout &L = GetDomTreeLayout(unwrap(BB)->getParent());
+  auto P = L.Number.find(unwrap(BB));
+  auto C = L.Number.find(unwrap(Child));
+  if (P == L.Number.end() || C == L.Number.end())
+    return NULL;
 
-  return NULL;
+  // Child must be one of BB's children; the root has no slot of its own
+  // and is left at position 0
+  unsigned Slot = L.Position[C->second];
+  if (Slot < L.ChildBegin[P->second] || Slot >= L.ChildBegin[P->second + 1] ||
+      L.Children[Slot] != Child)
+    return NULL;
+  if (Slot + 1 == L.ChildBegin[P->second + 1])
+    return NULL;
+  return L.Children[Slot + 1];
 }
 
 
 LLVMBasicBlockRef LLVMNearestCommonDominator(LLVMBasicBlockRef A, LLVMBasicBlockRef B)
 {
-  UpdateDominators(unwrap(A)->getParent());
-  return wrap(DT->findNearestCommonDominator(unwrap(A),unwrap(B)));
+  DominatorTreeBase<BasicBlock,false> &DT = GetDominatorTree(unwrap(A)->getParent());
+  return wrap(DT.findNearestCommonDominator(unwrap(A),unwrap(B)));
 }
 
 unsigned LLVMGetLoopNestingDepth(LLVMBasicBlockRef BB)
 {
-  if (LI==NULL)
-    UpdateDominators(unwrap(BB)->getParent());
-
-  return LI->getLoopDepth(unwrap(BB));
+  return GetLoopInfo(unwrap(BB)->getParent()).getLoopDepth(unwrap(BB));
 }
 
 
-LLVMBasicBlockRef LLVMDominanceFrontierLocal(LLVMBasicBlockRef BB)
+const LLVMBasicBlockRef *LLVMDominanceFrontierLocal(LLVMBasicBlockRef BB, unsigned *Count)
 {
-  return NULL;
+  BasicBlock *B = unwrap(BB);
+  return FrontierLocal(GetDominanceFrontier(B->getParent()), B, Count);
 }
 
-LLVMBasicBlockRef LLVMDominanceFrontierClosure(LLVMBasicBlockRef BB)
+const LLVMBasicBlockRef *LLVMDominanceFrontierClosure(LLVMBasicBlockRef BB, unsigned *Count)
 {
-  return NULL;
+  BasicBlock *B = unwrap(BB);
+  return FrontierClosure(GetDominanceFrontier(B->getParent()), B, Count);
 }
 
-LLVMBasicBlockRef LLVMPostDominanceFrontierLocal(LLVMBasicBlockRef BB)
+const LLVMBasicBlockRef *LLVMPostDominanceFrontierLocal(LLVMBasicBlockRef BB, unsigned *Count)
 {
-  return NULL;
+  BasicBlock *B = unwrap(BB);
+  return FrontierLocal(GetPostDominanceFrontier(B->getParent()), B, Count);
 }
 
-LLVMBasicBlockRef LLVMPostDominanceFrontierClosure(LLVMBasicBlockRef BB)
+const LLVMBasicBlockRef *LLVMPostDominanceFrontierClosure(LLVMBasicBlockRef BB, unsigned *Count)
 {
-  return NULL;
+  BasicBlock *B = unwrap(BB);
+  return FrontierClosure(GetPostDominanceFrontier(B->getParent()), B, Count);
 }
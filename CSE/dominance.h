@@ -11,6 +11,29 @@
 #include "llvm/IR/Module.h"
 #include "llvm/PassRegistry.h"
 #include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/Analysis/LoopInfo.h"
+
+/* Cached per function and recomputed only after LLVMInvalidateDominance */
+llvm::DominatorTreeBase<llvm::BasicBlock,false> &GetDominatorTree(llvm::Function *F);
+llvm::DominatorTreeBase<llvm::BasicBlock,true> &GetPostDominatorTree(llvm::Function *F);
+llvm::LoopInfoBase<llvm::BasicBlock,llvm::Loop> &GetLoopInfo(llvm::Function *F);
+
+/* How often each analysis was computed on the calling thread */
+struct AnalysisCounts {
+  unsigned DT = 0;
+  unsigned PDT = 0;
+  unsigned LI = 0;
+  unsigned Layout = 0;
+  unsigned DF = 0;
+  unsigned PDF = 0;
+};
+const AnalysisCounts &GetAnalysisCounts();
+
+/* Appends the iterated dominance frontier of Blocks to Result */
+void GetIteratedDominanceFrontier(llvm::Function *F,
+                                  llvm::ArrayRef<llvm::BasicBlock*> Blocks,
+                                  llvm::SmallVectorImpl<llvm::BasicBlock*> &Result);
 
 extern "C" {
 #endif
@@ -27,7 +50,24 @@ unsigned LLVMGetLoopNestingDepth(LLVMBasicBlockRef BB);
 LLVMBasicBlockRef LLVMFirstDomChild(LLVMBasicBlockRef BB);
 LLVMBasicBlockRef LLVMNextDomChild(LLVMBasicBlockRef BB, LLVMBasicBlockRef Child);
 
+/* Children of BB in the dominator tree as *Count contiguous blocks, valid
+   until the CFG of BB's function is invalidated */
+const LLVMBasicBlockRef *LLVMGetDomChildren(LLVMBasicBlockRef BB, unsigned *Count);
+
+/* Frontiers of BB as *Count contiguous blocks, valid until the CFG of BB's
+   function is invalidated.  The closure is the iterated frontier. */
+const LLVMBasicBlockRef *LLVMDominanceFrontierLocal(LLVMBasicBlockRef BB, unsigned *Count);
+const LLVMBasicBlockRef *LLVMDominanceFrontierClosure(LLVMBasicBlockRef BB, unsigned *Count);
+const LLVMBasicBlockRef *LLVMPostDominanceFrontierLocal(LLVMBasicBlockRef BB, unsigned *Count);
+const LLVMBasicBlockRef *LLVMPostDominanceFrontierClosure(LLVMBasicBlockRef BB, unsigned *Count);
+
   LLVMBool LLVMIsReachableFromEntry(LLVMValueRef Fun, LLVMBasicBlockRef bb);
+
+/* Must be called after changing the CFG of Fun; bumps its epoch so every
+   cached analysis of Fun is recomputed on its next query */
+void LLVMInvalidateDominance(LLVMValueRef Fun);
+/* Must be called before the functions last queried are deleted */
+void LLVMClearDominanceCache(void);
 #ifdef __cplusplus
 }
 #endif
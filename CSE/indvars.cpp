@@ -0,0 +1,265 @@
+/*
+ * File: indvars.cpp
+ *
+ * Description:
+ *   Induction variable analysis and loop strength reduction.  A basic
+ *   induction variable is a header phi that starts at an invariant value
+ *   and grows by an invariant step each trip around the loop.  Any
+ *   multiple of it by an invariant factor grows by the factor times the
+ *   step, so the multiplication is replaced by a new induction variable
+ *   that is bumped with an add.  Induction variables that always hold the
+ *   same value are then merged, and those nothing uses are removed.
+ */
+
+/* LLVM Header Files */
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Value.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
+#include <vector>
+#include "dominance.h"
+
+using namespace llvm;
+#include "CSE.h"
+
+namespace {
+
+/* Phi == Init on entry, and Next == Phi + Step feeds it from the latch */
+struct InductionVariable {
+  PHINode *Phi;
+  Value *Init;
+  Value *Step;
+  BinaryOperator *Next;
+};
+
+} // end anonymous namespace
+
+static bool _IsLoopInvariant(Loop *L, Value *V)
+{
+  Instruction *I = dyn_cast<Instruction>(V);
+  return I == nullptr || !L->contains(I->getParent());
+}
+
+static bool _FindInductionVariable(Loop *L, PHINode &PN, InductionVariable &IV)
+{
+  BasicBlock *Preheader = L->getLoopPreheader();
+  BasicBlock *Latch = L->getLoopLatch();
+  if (!PN.getType()->isIntegerTy() || PN.getNumIncomingValues() != 2)
+    return false;
+
+  int PreheaderIndex = PN.getBasicBlockIndex(Preheader);
+  int LatchIndex = PN.getBasicBlockIndex(Latch);
+  if (PreheaderIndex < 0 || LatchIndex < 0)
+    return false;
+
+  BinaryOperator *Next = dyn_cast<BinaryOperator>(PN.getIncomingValue(LatchIndex));
+  if (Next == nullptr || !L->contains(Next->getParent()))
+    return false;
+
+  Value *Step = nullptr;
+  if (Next->getOpcode() == Instruction::Add) {
+    if (Next->getOperand(0) == &PN)
+      Step = Next->getOperand(1);
+    else if (Next->getOperand(1) == &PN)
+      Step = Next->getOperand(0);
+  } else if (Next->getOpcode() == Instruction::Sub && Next->getOperand(0) == &PN) {
+    // only a constant can be negated without a new instruction
+    if (ConstantInt *C = dyn_cast<ConstantInt>(Next->getOperand(1)))
+      Step = ConstantExpr::getNeg(C);
+  }
+
+  if (Step == nullptr || !_IsLoopInvariant(L, Step))
+    return false;
+
+  IV.Phi = &PN;
+  IV.Init = PN.getIncomingValue(PreheaderIndex);
+  IV.Step = Step;
+  IV.Next = Next;
+  return true;
+}
+
+static void _FindInductionVariables(Loop *L, std::vector<InductionVariable> &IVs)
+{
+  IVs.clear();
+  if (L->getLoopPreheader() == nullptr || L->getLoopLatch() == nullptr)
+    return;
+
+  InductionVariable IV;
+  for (PHINode &PN : L->getHeader()->phis())
+    if (_FindInductionVariable(L, PN, IV))
+      IVs.push_back(IV);
+}
+
+/* Returns the invariant factor if I multiplies V by one, or null */
+static Value *_ScaleFactor(Loop *L, Instruction *I, Value *V)
+{
+  if (I->getOpcode() == Instruction::Mul) {
+    Value *Other = I->getOperand(0) == V ? I->getOperand(1) : I->getOperand(0);
+    if (Other != V && _IsLoopInvariant(L, Other))
+      return Other;
+  } else if (I->getOpcode() == Instruction::Shl && I->getOperand(0) == V) {
+    ConstantInt *Amount = dyn_cast<ConstantInt>(I->getOperand(1));
+    unsigned Width = V->getType()->getIntegerBitWidth();
+    if (Amount && Amount->getValue().ult(Width))
+      return ConstantInt::get(V->getType(),
+                              APInt::getOneBitSet(Width, Amount->getZExtValue()));
+  }
+  return nullptr;
+}
+
+static Value *_CreateMul(IRBuilder<> &Builder, Value *L, Value *R, const Twine &Name)
+{
+  // the start and step are often 0 or 1
+  for (Value *V : {L, R})
+    if (ConstantInt *C = dyn_cast<ConstantInt>(V)) {
+      if (C->isZero())
+        return C;
+      if (C->isOne())
+        return V == L ? R : L;
+    }
+  return Builder.CreateMul(L, R, Name);
+}
+
+/*
+ * Every multiple of an induction variable in the loop becomes a new
+ * induction variable; multiples by the same factor share one.
+ */
+static void _ReduceMultiplies(Loop *L, InductionVariable &IV)
+{
+  BasicBlock *Preheader = L->getLoopPreheader();
+  BasicBlock *Latch = L->getLoopLatch();
+  DenseMap<Value*, std::pair<PHINode*, Instruction*>> Reduced;
+
+  SmallVector<Instruction*, 8> Candidates;
+  for (Value *V : {(Value*)IV.Phi, (Value*)IV.Next})
+    for (User *U : V->users()) {
+      Instruction *I = dyn_cast<Instruction>(U);
+      if (I && I != IV.Next && L->contains(I->getParent()) && _ScaleFactor(L, I, V))
+        Candidates.push_back(I);
+    }
+
+  for (Instruction *I : Candidates) {
+    bool OfPhi = I->getOperand(0) == IV.Phi || I->getOperand(1) == IV.Phi;
+    Value *Factor = _ScaleFactor(L, I, OfPhi ? (Value*)IV.Phi : (Value*)IV.Next);
+    if (Factor == nullptr)
+      continue;
+
+    auto It = Reduced.find(Factor);
+    if (It == Reduced.end()) {
+      IRBuilder<> Builder(Preheader->getTerminator());
+      Value *Init = _CreateMul(Builder, IV.Init, Factor, IV.Phi->getName() + ".init");
+      Value *Step = _CreateMul(Builder, IV.Step, Factor, IV.Phi->getName() + ".step");
+
+      PHINode *Phi = PHINode::Create(IV.Phi->getType(), 2, IV.Phi->getName() + ".sr",
+                                     IV.Phi);
+      Builder.SetInsertPoint(IV.Next->getNextNode());
+      Instruction *Next = cast<Instruction>(Builder.CreateAdd(Phi, Step,
+                                                              Phi->getName() + ".next"));
+      Phi->addIncoming(Init, Preheader);
+      Phi->addIncoming(Next, Latch);
+      It = Reduced.insert(std::make_pair(Factor, std::make_pair(Phi, Next))).first;
+    }
+
+    I->replaceAllUsesWith(OfPhi ? (Value*)It->second.first : (Value*)It->second.second);
+    I->eraseFromParent();
+    CSEStats.Strength++;
+  }
+}
+
+static bool _Dominates(Instruction *A, Instruction *B)
+{
+  if (A->getParent() == B->getParent())
+    return A->comesBefore(B);
+  return LLVMDominates(wrap(A->getFunction()), wrap(A->getParent()), wrap(B->getParent()));
+}
+
+/* Two variables that start equal and step equally are always equal */
+static void _MergeInductionVariables(std::vector<InductionVariable> &IVs)
+{
+  for (unsigned i = 0; i < IVs.size(); i++)
+    for (unsigned j = i + 1; j < IVs.size(); j++) {
+      InductionVariable &A = IVs[i];
+      InductionVariable &B = IVs[j];
+      if (A.Phi == nullptr || B.Phi == nullptr || A.Phi->getType() != B.Phi->getType() ||
+          A.Init != B.Init || A.Step != B.Step)
+        continue;
+
+      // the surviving increment must be available to every user of the other
+      InductionVariable &Keep = _Dominates(A.Next, B.Next) ? A : B;
+      InductionVariable &Drop = &Keep == &A ? B : A;
+      if (!_Dominates(Keep.Next, Drop.Next))
+        continue;
+
+      Keep.Next->dropPoisonGeneratingFlags();
+      Drop.Phi->replaceAllUsesWith(Keep.Phi);
+      Drop.Next->replaceAllUsesWith(Keep.Next);
+      Drop.Phi->eraseFromParent();
+      Drop.Next->eraseFromParent();
+      Drop.Phi = nullptr;
+      CSEStats.IndVars++;
+    }
+}
+
+static void _RemoveDeadInductionVariables(std::vector<InductionVariable> &IVs)
+{
+  for (InductionVariable &IV : IVs) {
+    if (IV.Phi == nullptr)
+      continue;
+
+    bool Dead = true;
+    for (User *U : IV.Phi->users())
+      Dead &= U == IV.Next;
+    for (User *U : IV.Next->users())
+      Dead &= U == IV.Phi;
+    if (!Dead)
+      continue;
+
+    IV.Phi->replaceAllUsesWith(UndefValue::get(IV.Phi->getType()));
+    IV.Phi->eraseFromParent();
+    IV.Next->eraseFromParent();
+    IV.Phi = nullptr;
+    CSEStats.IndVars++;
+  }
+}
+
+static void _RunLoopStrengthReduction(Function &F)
+{
+  if (F.isDeclaration())
+    return;
+
+  LoopInfoBase<BasicBlock,Loop> &LI = GetLoopInfo(&F);
+
+  // inner loops first, so their preheader multiplies can be reduced in
+  // the enclosing loop
+  SmallVector<Loop*, 8> Loops = LI.getLoopsInPreorder();
+  std::vector<InductionVariable> IVs;
+  for (auto it = Loops.rbegin(); it != Loops.rend(); ++it) {
+    Loop *L = *it;
+
+    // merging first lets the multiples of both share one new variable
+    _FindInductionVariables(L, IVs);
+    _MergeInductionVariables(IVs);
+    for (InductionVariable &IV : IVs)
+      if (IV.Phi != nullptr)
+        _ReduceMultiplies(L, IV);
+
+    // look again to pick up the variables that were just created
+    _FindInductionVariables(L, IVs);
+    _MergeInductionVariables(IVs);
+    _RemoveDeadInductionVariables(IVs);
+  }
+}
+
+void RunLoopStrengthReduction(Module &M)
+{
+  for (Module::iterator f = M.begin(); f != M.end(); f++) {
+    PassProfile Profile("lsr", *f);
+    _RunLoopStrengthReduction(*f);
+  }
+}
@@ -0,0 +1,271 @@
+/*
+ * File: licm.cpp
+ *
+ * Description:
+ *   Loop-invariant code motion.  Instructions whose operands are all
+ *   defined outside a loop compute the same value on every iteration, so
+ *   they are hoisted into the loop's preheader, which is created first
+ *   when the front end did not emit one.  A store to an invariant address
+ *   that nothing else in the loop touches is sunk into the loop exits,
+ *   leaving only the last value written.
+ */
+
+/* LLVM Header Files */
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Value.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/SmallVector.h"
+#include <vector>
+#include "dominance.h"
+
+using namespace llvm;
+#include "CSE.h"
+
+namespace {
+
+struct LoopSummary {
+  Loop *L;
+  bool WritesMemory = false;
+  bool HasCalls = false;
+  SmallVector<BasicBlock*, 4> Exits;
+};
+
+} // end anonymous namespace
+
+static void _SummarizeLoop(Loop *L, LoopSummary &S)
+{
+  S.L = L;
+  for (BasicBlock *BB : L->blocks())
+    for (Instruction &I : *BB) {
+      if (I.mayWriteToMemory())
+        S.WritesMemory = true;
+      if (isa<CallBase>(I))
+        S.HasCalls = true;
+    }
+  L->getUniqueExitBlocks(S.Exits);
+}
+
+static bool _IsInvariant(Loop *L, Value *V)
+{
+  Instruction *I = dyn_cast<Instruction>(V);
+  return I == nullptr || !L->contains(I->getParent());
+}
+
+/* True if BB runs on every iteration that leaves the loop; a call may
+   never return, so none is allowed on the way */
+static bool _IsGuaranteedToExecute(const LoopSummary &S, BasicBlock *BB)
+{
+  if (S.Exits.empty() || S.HasCalls)
+    return false;
+
+  LLVMValueRef Fun = wrap(BB->getParent());
+  for (BasicBlock *Exit : S.Exits)
+    if (!LLVMDominates(Fun, wrap(BB), wrap(Exit)))
+      return false;
+  return true;
+}
+
+static bool _CanHoist(const LoopSummary &S, Instruction &I)
+{
+  if (isa<PHINode>(I) || I.isTerminator() || isa<AllocaInst>(I) ||
+      isa<CallBase>(I) || I.isEHPad() || I.mayHaveSideEffects())
+    return false;
+
+  for (Value *Op : I.operands())
+    if (!_IsInvariant(S.L, Op))
+      return false;
+
+  // a load must see the same memory on every iteration
+  if (I.mayReadFromMemory()) {
+    LoadInst *LI = dyn_cast<LoadInst>(&I);
+    if (LI == nullptr || !LI->isSimple() || S.WritesMemory)
+      return false;
+  }
+
+  // anything that may trap must have run anyway
+  return isSafeToSpeculativelyExecute(&I) || _IsGuaranteedToExecute(S, I.getParent());
+}
+
+/*
+ * Only locations based on distinct allocas or globals are known not to
+ * overlap; everything else may alias.
+ */
+static const Value *_IdentifiedObject(Value *Ptr)
+{
+  const Value *Obj = getUnderlyingObject(Ptr);
+  if (isa<AllocaInst>(Obj) || isa<GlobalVariable>(Obj))
+    return Obj;
+  return nullptr;
+}
+
+static bool _CanSink(const LoopSummary &S, StoreInst &SI)
+{
+  if (!SI.isSimple())
+    return false;
+  if (!_IsInvariant(S.L, SI.getPointerOperand()))
+    return false;
+
+  // the last value stored must be the one stored on the way out
+  if (!_IsGuaranteedToExecute(S, SI.getParent()))
+    return false;
+
+  for (BasicBlock *Exit : S.Exits)
+    for (BasicBlock *Pred : predecessors(Exit))
+      if (!S.L->contains(Pred))
+        return false;
+
+  const Value *Obj = _IdentifiedObject(SI.getPointerOperand());
+  if (Obj == nullptr)
+    return false;
+
+  for (BasicBlock *BB : S.L->blocks())
+    for (Instruction &I : *BB) {
+      if (&I == &SI || !I.mayReadOrWriteMemory())
+        continue;
+
+      Value *Ptr = nullptr;
+      if (LoadInst *LI = dyn_cast<LoadInst>(&I))
+        Ptr = LI->getPointerOperand();
+      else if (StoreInst *Other = dyn_cast<StoreInst>(&I))
+        Ptr = Other->getPointerOperand();
+
+      const Value *OtherObj = Ptr ? _IdentifiedObject(Ptr) : nullptr;
+      if (OtherObj == nullptr || OtherObj == Obj)
+        return false;
+    }
+  return true;
+}
+
+static bool _HasCandidates(Loop *L)
+{
+  LoopSummary S;
+  _SummarizeLoop(L, S);
+  for (BasicBlock *BB : L->blocks())
+    for (Instruction &I : *BB) {
+      if (_CanHoist(S, I))
+        return true;
+      if (StoreInst *SI = dyn_cast<StoreInst>(&I))
+        if (_CanSink(S, *SI))
+          return true;
+    }
+  return false;
+}
+
+/*
+ * Gives the loop a single block that branches only to its header, moving
+ * the incoming values of the header's phis that come from outside the
+ * loop into phis of the new block.
+ */
+static bool _InsertPreheader(Loop *L)
+{
+  BasicBlock *Header = L->getHeader();
+
+  SmallVector<BasicBlock*, 4> Outside;
+  for (BasicBlock *Pred : predecessors(Header))
+    if (!L->contains(Pred) && !is_contained(Outside, Pred))
+      Outside.push_back(Pred);
+
+  if (Outside.empty())
+    return false;
+  for (BasicBlock *Pred : Outside)
+    if (!isa<BranchInst>(Pred->getTerminator()) && !isa<SwitchInst>(Pred->getTerminator()))
+      return false;
+
+  Function *F = Header->getParent();
+  BasicBlock *Preheader = BasicBlock::Create(Header->getContext(),
+                                             Header->getName() + ".preheader", F, Header);
+
+  for (PHINode &PN : Header->phis()) {
+    PHINode *NewPN = PHINode::Create(PN.getType(), 2, PN.getName() + ".ph", Preheader);
+    for (unsigned i = PN.getNumIncomingValues(); i-- > 0; )
+      if (!L->contains(PN.getIncomingBlock(i))) {
+        NewPN->addIncoming(PN.getIncomingValue(i), PN.getIncomingBlock(i));
+        PN.removeIncomingValue(i, false);
+      }
+
+    Value *In = NewPN;
+    if (Value *Same = NewPN->hasConstantValue()) {
+      In = Same;
+      NewPN->eraseFromParent();
+    }
+    PN.addIncoming(In, Preheader);
+  }
+
+  BranchInst::Create(Header, Preheader);
+  for (BasicBlock *Pred : Outside)
+    Pred->getTerminator()->replaceSuccessorWith(Header, Preheader);
+  return true;
+}
+
+static void _HoistAndSink(Loop *L, BasicBlock *Preheader)
+{
+  LoopSummary S;
+  _SummarizeLoop(L, S);
+  Instruction *InsertPt = Preheader->getTerminator();
+
+  // walk the loop's part of the dominator tree so operands move before users
+  std::vector<BasicBlock*> Stack(1, L->getHeader());
+  while (!Stack.empty()) {
+    BasicBlock *BB = Stack.back();
+    Stack.pop_back();
+
+    for (Instruction &I : make_early_inc_range(*BB)) {
+      if (_CanHoist(S, I)) {
+        I.moveBefore(InsertPt);
+        CSEStats.Licm++;
+      } else if (StoreInst *SI = dyn_cast<StoreInst>(&I)) {
+        if (!_CanSink(S, *SI))
+          continue;
+        for (BasicBlock *Exit : S.Exits)
+          SI->clone()->insertBefore(&*Exit->getFirstInsertionPt());
+        SI->eraseFromParent();
+        CSEStats.Licm++;
+      }
+    }
+
+    unsigned Count;
+    const LLVMBasicBlockRef *Children = LLVMGetDomChildren(wrap(BB), &Count);
+    for (unsigned i = 0; i < Count; i++)
+      if (L->contains(unwrap(Children[i])))
+        Stack.push_back(unwrap(Children[i]));
+  }
+}
+
+static void _RunLoopInvariantCodeMotion(Function &F)
+{
+  if (F.isDeclaration())
+    return;
+
+  LoopInfoBase<BasicBlock,Loop> &LI = GetLoopInfo(&F);
+  if (LI.empty())
+    return;
+
+  // new preheaders change the CFG, so they all go in before any hoisting
+  bool ChangedCFG = false;
+  for (Loop *L : LI.getLoopsInPreorder())
+    if (L->getLoopPreheader() == nullptr && _HasCandidates(L))
+      ChangedCFG |= _InsertPreheader(L);
+
+  if (ChangedCFG)
+    LLVMInvalidateDominance(wrap(&F));
+
+  // inner loops first, so what they hoist can leave the outer loop too
+  SmallVector<Loop*, 8> Loops = GetLoopInfo(&F).getLoopsInPreorder();
+  for (auto it = Loops.rbegin(); it != Loops.rend(); ++it)
+    if (BasicBlock *Preheader = (*it)->getLoopPreheader())
+      _HoistAndSink(*it, Preheader);
+}
+
+void RunLoopInvariantCodeMotion(Module &M)
+{
+  for (Module::iterator f = M.begin(); f != M.end(); f++) {
+    PassProfile Profile("licm", *f);
+    _RunLoopInvariantCodeMotion(*f);
+  }
+}
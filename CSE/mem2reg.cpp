@@ -0,0 +1,270 @@
+/*
+ * File: mem2reg.cpp
+ *
+ * Description:
+ *   Promotes allocas to SSA registers.  The front end gives every local
+ *   and parameter a stack slot and reaches it only through loads and
+ *   stores; as long as the slot's address never escapes, each load can be
+ *   replaced by the value last stored on the path that reaches it.  Phis
+ *   are placed at the iterated dominance frontier of the stores, pruned
+ *   to the blocks where the slot is live, and the values are renamed in
+ *   one walk over the dominator tree.
+ */
+
+/* LLVM Header Files */
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Value.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/SmallVector.h"
+#include <vector>
+#include "dominance.h"
+
+using namespace llvm;
+#include "CSE.h"
+
+namespace {
+
+struct PromotedSlot {
+  AllocaInst *AI;
+  SmallPtrSet<BasicBlock*, 8> DefBlocks;
+  SmallPtrSet<BasicBlock*, 8> UseBlocks;
+};
+
+} // end anonymous namespace
+
+static bool _IsPromotable(AllocaInst *AI)
+{
+  if (AI->isArrayAllocation() || !_IsTrackedAlloca(AI))
+    return false;
+
+  // a phi needs one type, so every access must agree with the slot
+  Type *Ty = AI->getAllocatedType();
+  for (User *U : AI->users()) {
+    if (LoadInst *LI = dyn_cast<LoadInst>(U)) {
+      if (!LI->isSimple() || LI->getType() != Ty)
+        return false;
+    } else {
+      StoreInst *SI = cast<StoreInst>(U);
+      if (!SI->isSimple() || SI->getValueOperand()->getType() != Ty)
+        return false;
+    }
+  }
+  return true;
+}
+
+static bool _LoadsBeforeStore(BasicBlock *BB, AllocaInst *AI)
+{
+  for (Instruction &I : *BB) {
+    if (LoadInst *LI = dyn_cast<LoadInst>(&I))
+      if (LI->getPointerOperand() == AI)
+        return true;
+    if (StoreInst *SI = dyn_cast<StoreInst>(&I))
+      if (SI->getPointerOperand() == AI)
+        return false;
+  }
+  return false;
+}
+
+/*
+ * A slot is live into a block if the block reads it before writing it, or
+ * if a successor needs it and the block does not write it.
+ */
+static void _ComputeLiveInBlocks(PromotedSlot &S, SmallPtrSetImpl<BasicBlock*> &LiveIn)
+{
+  SmallVector<BasicBlock*, 16> Worklist;
+  for (BasicBlock *BB : S.UseBlocks)
+    if (!S.DefBlocks.count(BB) || _LoadsBeforeStore(BB, S.AI))
+      if (LiveIn.insert(BB).second)
+        Worklist.push_back(BB);
+
+  while (!Worklist.empty()) {
+    BasicBlock *BB = Worklist.pop_back_val();
+    for (BasicBlock *Pred : predecessors(BB))
+      if (!S.DefBlocks.count(Pred) && LiveIn.insert(Pred).second)
+        Worklist.push_back(Pred);
+  }
+}
+
+static void _RemoveTrivialPhis(std::vector<PHINode*> &Phis)
+{
+  SmallPtrSet<PHINode*, 16> Erased;
+  bool Changed = true;
+
+  // removing one phi can make the phis that used it trivial
+  while (Changed) {
+    Changed = false;
+    for (PHINode *PN : Phis) {
+      if (Erased.count(PN))
+        continue;
+
+      Value *Same = nullptr;
+      bool Trivial = true;
+      for (Value *In : PN->incoming_values()) {
+        if (In == PN || In == Same)
+          continue;
+        if (Same != nullptr) {
+          Trivial = false;
+          break;
+        }
+        Same = In;
+      }
+      if (!Trivial)
+        continue;
+
+      if (Same == nullptr)
+        Same = UndefValue::get(PN->getType());
+      PN->replaceAllUsesWith(Same);
+      PN->eraseFromParent();
+      Erased.insert(PN);
+      Changed = true;
+    }
+  }
+}
+
+static void _PromoteAllocas(Function &F)
+{
+  if (F.isDeclaration())
+    return;
+
+  std::vector<PromotedSlot> Slots;
+  DenseMap<AllocaInst*, unsigned> SlotNumber;
+
+  for (Instruction &I : F.getEntryBlock())
+    if (AllocaInst *AI = dyn_cast<AllocaInst>(&I))
+      if (_IsPromotable(AI)) {
+        SlotNumber[AI] = Slots.size();
+        Slots.push_back(PromotedSlot());
+        Slots.back().AI = AI;
+      }
+
+  if (Slots.empty())
+    return;
+
+  for (PromotedSlot &S : Slots)
+    for (User *U : S.AI->users()) {
+      BasicBlock *BB = cast<Instruction>(U)->getParent();
+      if (isa<StoreInst>(U))
+        S.DefBlocks.insert(BB);
+      else
+        S.UseBlocks.insert(BB);
+    }
+
+  // pruned SSA: a phi only where the slot is live and stores meet
+  DenseMap<PHINode*, unsigned> PhiSlot;
+  DenseMap<BasicBlock*, SmallVector<PHINode*, 4>> BlockPhis;
+  std::vector<PHINode*> Phis;
+
+  for (unsigned i = 0; i < Slots.size(); i++) {
+    PromotedSlot &S = Slots[i];
+    if (S.UseBlocks.empty())
+      continue;
+
+    SmallPtrSet<BasicBlock*, 16> LiveIn;
+    _ComputeLiveInBlocks(S, LiveIn);
+
+    SmallVector<BasicBlock*, 8> Defs(S.DefBlocks.begin(), S.DefBlocks.end());
+    SmallVector<BasicBlock*, 16> Frontier;
+    GetIteratedDominanceFrontier(&F, Defs, Frontier);
+
+    for (BasicBlock *BB : Frontier) {
+      if (!LiveIn.count(BB))
+        continue;
+      PHINode *PN = PHINode::Create(S.AI->getAllocatedType(), pred_size(BB),
+                                    S.AI->getName() + ".phi", &BB->front());
+      PhiSlot[PN] = i;
+      BlockPhis[BB].push_back(PN);
+      Phis.push_back(PN);
+    }
+  }
+
+  // rename along the dominator tree; Current is rolled back on the way up
+  std::vector<Value*> Current;
+  for (PromotedSlot &S : Slots)
+    Current.push_back(UndefValue::get(S.AI->getAllocatedType()));
+
+  std::vector<std::pair<unsigned, Value*>> UndoLog;
+  std::vector<size_t> Marks;
+
+  _WalkDominatorTree(F,
+    [&](BasicBlock &BB) {
+      Marks.push_back(UndoLog.size());
+
+      auto Phi = BlockPhis.find(&BB);
+      if (Phi != BlockPhis.end())
+        for (PHINode *PN : Phi->second) {
+          unsigned i = PhiSlot[PN];
+          UndoLog.push_back(std::make_pair(i, Current[i]));
+          Current[i] = PN;
+        }
+
+      for (Instruction &I : make_early_inc_range(BB)) {
+        if (LoadInst *LI = dyn_cast<LoadInst>(&I)) {
+          AllocaInst *AI = dyn_cast<AllocaInst>(LI->getPointerOperand());
+          auto It = AI ? SlotNumber.find(AI) : SlotNumber.end();
+          if (It == SlotNumber.end())
+            continue;
+          LI->replaceAllUsesWith(Current[It->second]);
+          LI->eraseFromParent();
+        } else if (StoreInst *SI = dyn_cast<StoreInst>(&I)) {
+          AllocaInst *AI = dyn_cast<AllocaInst>(SI->getPointerOperand());
+          auto It = AI ? SlotNumber.find(AI) : SlotNumber.end();
+          if (It == SlotNumber.end())
+            continue;
+          UndoLog.push_back(std::make_pair(It->second, Current[It->second]));
+          Current[It->second] = SI->getValueOperand();
+          SI->eraseFromParent();
+        }
+      }
+
+      // one incoming value per edge, so repeated successors repeat it
+      for (BasicBlock *Succ : successors(&BB)) {
+        auto SuccPhi = BlockPhis.find(Succ);
+        if (SuccPhi != BlockPhis.end())
+          for (PHINode *PN : SuccPhi->second)
+            PN->addIncoming(Current[PhiSlot[PN]], &BB);
+      }
+    },
+    [&](BasicBlock &) {
+      size_t Mark = Marks.back();
+      Marks.pop_back();
+      while (UndoLog.size() > Mark) {
+        Current[UndoLog.back().first] = UndoLog.back().second;
+        UndoLog.pop_back();
+      }
+    });
+
+  // edges from unreachable blocks were never walked
+  for (PHINode *PN : Phis)
+    for (BasicBlock *Pred : predecessors(PN->getParent()))
+      if (!LLVMIsReachableFromEntry(wrap(&F), wrap(Pred)))
+        PN->addIncoming(UndefValue::get(PN->getType()), Pred);
+
+  _RemoveTrivialPhis(Phis);
+
+  // only accesses in unreachable blocks are left
+  for (PromotedSlot &S : Slots) {
+    while (!S.AI->use_empty()) {
+      Instruction *I = cast<Instruction>(S.AI->user_back());
+      if (!I->use_empty())
+        I->replaceAllUsesWith(UndefValue::get(I->getType()));
+      I->eraseFromParent();
+    }
+    S.AI->eraseFromParent();
+    CSEStats.Promoted++;
+  }
+}
+
+void RunPromoteMemoryToRegister(Module &M)
+{
+  for (Module::iterator f = M.begin(); f != M.end(); f++) {
+    PassProfile Profile("mem2reg", *f);
+    _PromoteAllocas(*f);
+  }
+}
@@ -0,0 +1,210 @@
+/*
+ * File: parallel.cpp
+ *
+ * Description:
+ *   Runs the optimization pipeline over the functions of a module on a
+ *   thread pool.  An LLVMContext may only be used by one thread at a time:
+ *   constants are uniqued in it and the use lists of constants and globals
+ *   are shared by every function.  So the defined functions are split into
+ *   one partition per worker, each partition is cloned into a module of its
+ *   own and handed to its worker as bitcode, and the worker parses it into
+ *   a private context.  The optimized bodies are then spliced back into the
+ *   original module.
+ */
+
+/* LLVM Header Files */
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Value.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/ValueMapper.h"
+#include <algorithm>
+#include <vector>
+#include "dominance.h"
+
+using namespace llvm;
+#include "CSE.h"
+
+namespace {
+
+struct Partition {
+  std::vector<unsigned> Functions;  // indices into the module's function list
+  size_t Size = 0;                  // instructions, used for balancing
+  SmallVector<char, 0> Input;       // bitcode handed to the worker
+  SmallVector<char, 0> Output;      // bitcode handed back
+  CSEStatistics Stats;
+};
+
+} // end anonymous namespace
+
+static std::vector<Partition> _PartitionFunctions(Module &M, unsigned Count)
+{
+  std::vector<std::pair<size_t, unsigned>> Sizes;
+  unsigned Index = 0;
+  for (Function &F : M) {
+    if (!F.isDeclaration())
+      Sizes.push_back(std::make_pair(F.getInstructionCount(), Index));
+    Index++;
+  }
+
+  // largest function first, each onto the lightest partition so far
+  std::sort(Sizes.rbegin(), Sizes.rend());
+  std::vector<Partition> Parts(std::min<size_t>(Count, Sizes.size()));
+  for (auto &S : Sizes) {
+    Partition &Lightest = *std::min_element(Parts.begin(), Parts.end(),
+      [](const Partition &A, const Partition &B) { return A.Size < B.Size; });
+    Lightest.Functions.push_back(S.second);
+    Lightest.Size += S.first;
+  }
+  return Parts;
+}
+
+static std::unique_ptr<Module> _ParseBitcode(const SmallVectorImpl<char> &Bitcode,
+                                             LLVMContext &Context)
+{
+  MemoryBufferRef Buffer(StringRef(Bitcode.data(), Bitcode.size()), "partition");
+  return cantFail(parseBitcodeFile(Buffer, Context));
+}
+
+void _WriteBitcode(Module &M, SmallVectorImpl<char> &Bitcode, bool PreserveUseListOrder)
+{
+  // use-list order keeps predecessor order, and so the output, from
+  // depending on the number of threads; no symbol table is needed since
+  // nothing but _ParseBitcode reads the result
+  BitcodeWriter Writer(Bitcode);
+  Writer.writeModule(M, PreserveUseListOrder);
+  Writer.writeStrtab();
+}
+
+static void _WritePartition(Module &M, const std::vector<Function*> &Functions,
+                            Partition &P)
+{
+  SmallPtrSet<const GlobalValue*, 16> Owned;
+  for (unsigned Index : P.Functions)
+    Owned.insert(Functions[Index]);
+
+  // everything outside the partition becomes a declaration
+  ValueToValueMapTy VMap;
+  std::unique_ptr<Module> Part = CloneModule(M, VMap,
+    [&](const GlobalValue *GV) { return Owned.count(GV) != 0; });
+  _WriteBitcode(*Part, P.Input);
+}
+
+CSEStatistics _OptimizeBitcode(const SmallVectorImpl<char> &Input,
+                               SmallVectorImpl<char> &Output,
+                               function_ref<void(Module&)> Pipeline)
+{
+  LLVMContext Context;
+  std::unique_ptr<Module> Part = _ParseBitcode(Input, Context);
+
+  // pool threads are reused, so collect this module's counts on their own
+  CSEStatistics Saved = CSEStats;
+  CSEStats = CSEStatistics();
+  Pipeline(*Part);
+  LLVMClearDominanceCache();
+  CSEStatistics Stats = CSEStats;
+  CSEStats = Saved;
+
+  _WriteBitcode(*Part, Output);
+  return Stats;
+}
+
+static void _OptimizePartition(Partition &P, function_ref<void(Module&)> Pipeline)
+{
+  P.Stats = _OptimizeBitcode(P.Input, P.Output, Pipeline);
+}
+
+static void _MapGlobals(Module &M, Module &Part, const std::vector<Function*> &Functions,
+                        ValueToValueMapTy &VMap)
+{
+  // CloneModule and the bitcode round trip both keep every list in order
+  auto Map = [&](auto &&From, auto &&To) {
+    auto T = To.begin();
+    for (auto F = From.begin(); F != From.end() && T != To.end(); ++F, ++T)
+      VMap[&*F] = &*T;
+  };
+  Map(Part.globals(), M.globals());
+  Map(Part.aliases(), M.aliases());
+  Map(Part.ifuncs(), M.ifuncs());
+
+  // declarations a pass added, such as intrinsics, are looked up by name
+  unsigned Index = 0;
+  for (Function &F : Part) {
+    if (Index < Functions.size())
+      VMap[&F] = Functions[Index];
+    else
+      VMap[&F] = M.getOrInsertFunction(F.getName(), F.getFunctionType(),
+                                       F.getAttributes()).getCallee();
+    Index++;
+  }
+}
+
+void _ReplaceFunctionBody(Function *Dst, Function *Src, ValueToValueMapTy &VMap)
+{
+  Dst->dropAllReferences();
+  auto DstArg = Dst->arg_begin();
+  for (Argument &A : Src->args())
+    VMap[&A] = &*DstArg++;
+
+  SmallVector<ReturnInst*, 8> Returns;
+  CloneFunctionInto(Dst, Src, VMap, CloneFunctionChangeType::DifferentModule, Returns);
+}
+
+static void _ReadPartition(Module &M, const std::vector<Function*> &Functions,
+                           Partition &P)
+{
+  std::unique_ptr<Module> Part = _ParseBitcode(P.Output, M.getContext());
+
+  ValueToValueMapTy VMap;
+  _MapGlobals(M, *Part, Functions, VMap);
+
+  std::vector<Function*> PartFunctions;
+  for (Function &F : *Part)
+    PartFunctions.push_back(&F);
+
+  for (unsigned Index : P.Functions)
+    _ReplaceFunctionBody(Functions[Index], PartFunctions[Index], VMap);
+
+  CSEStats += P.Stats;
+}
+
+void RunPipelineInParallel(Module &M, unsigned Threads,
+                           function_ref<void(Module&)> Pipeline)
+{
+  std::vector<Partition> Parts = _PartitionFunctions(M, Threads);
+
+  // named struct types would be renamed when parsed back into M's context
+  if (Parts.size() < 2 || !M.getIdentifiedStructTypes().empty()) {
+    Pipeline(M);
+    return;
+  }
+
+  std::vector<Function*> Functions;
+  for (Function &F : M)
+    Functions.push_back(&F);
+
+  // M's context is only ever touched from this thread
+  for (Partition &P : Parts)
+    _WritePartition(M, Functions, P);
+
+  ThreadPool Pool(hardware_concurrency(Parts.size()));
+  for (Partition &P : Parts)
+    Pool.async([&P, Pipeline]() { _OptimizePartition(P, Pipeline); });
+  Pool.wait();
+
+  bool HadCompileUnits = M.getNamedMetadata("llvm.dbg.cu") != nullptr;
+  for (Partition &P : Parts)
+    _ReadPartition(M, Functions, P);
+
+  // cloning across modules creates the list even when there is no debug info
+  NamedMDNode *CompileUnits = M.getNamedMetadata("llvm.dbg.cu");
+  if (!HadCompileUnits && CompileUnits && CompileUnits->getNumOperands() == 0)
+    M.eraseNamedMetadata(CompileUnits);
+}
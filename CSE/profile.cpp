@@ -0,0 +1,143 @@
+/*
+ * File: profile.cpp
+ *
+ * Description:
+ *   Per-pass, per-function profiling of the optimizer.  Setting
+ *   CSE_PROFILE to a file name makes every pass record its wall time, the
+ *   instruction and block counts of each function before and after it
+ *   ran, and how many dominance analyses it had recomputed.  The records
+ *   are written to that file as CSV when its name ends in .csv and as
+ *   JSON otherwise.
+ */
+
+/* LLVM Header Files */
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Value.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Function.h"
+#include "llvm/ADT/StringRef.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include "dominance.h"
+
+using namespace llvm;
+#include "CSE.h"
+
+static const char *_ProfilePath()
+{
+  static const char *Path = getenv("CSE_PROFILE");
+  return Path;
+}
+
+PassProfile::PassProfile(const char *Pass, Function &F)
+  : Pass(Pass), F(F), Enabled(_ProfilePath() != nullptr && !F.isDeclaration())
+{
+  if (!Enabled)
+    return;
+
+  Insts = F.getInstructionCount();
+  Blocks = F.size();
+  Analyses = GetAnalysisCounts();
+  Start = std::chrono::steady_clock::now();
+}
+
+PassProfile::~PassProfile()
+{
+  if (!Enabled)
+    return;
+
+  std::chrono::duration<double> Elapsed = std::chrono::steady_clock::now() - Start;
+  const AnalysisCounts &Now = GetAnalysisCounts();
+
+  PassRecord R;
+  R.Pass = Pass;
+  R.Function = F.getName().str();
+  R.Seconds = Elapsed.count();
+  R.InstsBefore = Insts;
+  R.InstsAfter = F.getInstructionCount();
+  R.BlocksBefore = Blocks;
+  R.BlocksAfter = F.size();
+  R.Analyses.DT = Now.DT - Analyses.DT;
+  R.Analyses.PDT = Now.PDT - Analyses.PDT;
+  R.Analyses.LI = Now.LI - Analyses.LI;
+  R.Analyses.Layout = Now.Layout - Analyses.Layout;
+  R.Analyses.DF = Now.DF - Analyses.DF;
+  R.Analyses.PDF = Now.PDF - Analyses.PDF;
+  CSEStats.Profile.push_back(R);
+}
+
+static void _WriteJSONString(FILE *Out, const std::string &S)
+{
+  fputc('"', Out);
+  for (unsigned char c : S) {
+    if (c == '"' || c == '\\')
+      fprintf(Out, "\\%c", c);
+    else if (c < 0x20)
+      fprintf(Out, "\\u%04x", c);
+    else
+      fputc(c, Out);
+  }
+  fputc('"', Out);
+}
+
+static void _WriteCSVString(FILE *Out, const std::string &S)
+{
+  fputc('"', Out);
+  for (char c : S) {
+    if (c == '"')
+      fputc('"', Out);
+    fputc(c, Out);
+  }
+  fputc('"', Out);
+}
+
+static void _WriteJSON(FILE *Out, const std::vector<PassRecord> &Records)
+{
+  fprintf(Out, "{\n  \"passes\": [");
+  for (size_t i = 0; i < Records.size(); i++) {
+    const PassRecord &R = Records[i];
+    fprintf(Out, "%s\n    {\"pass\": \"%s\", \"function\": ", i ? "," : "", R.Pass);
+    _WriteJSONString(Out, R.Function);
+    fprintf(Out, ", \"seconds\": %.9f, \"instructions\": [%u, %u], \"blocks\": [%u, %u], ",
+            R.Seconds, R.InstsBefore, R.InstsAfter, R.BlocksBefore, R.BlocksAfter);
+    fprintf(Out, "\"analyses\": {\"dt\": %u, \"pdt\": %u, \"li\": %u, \"layout\": %u, "
+            "\"df\": %u, \"pdf\": %u}}",
+            R.Analyses.DT, R.Analyses.PDT, R.Analyses.LI, R.Analyses.Layout,
+            R.Analyses.DF, R.Analyses.PDF);
+  }
+  fprintf(Out, "\n  ]\n}\n");
+}
+
+static void _WriteCSV(FILE *Out, const std::vector<PassRecord> &Records)
+{
+  fprintf(Out, "pass,function,seconds,insts_before,insts_after,blocks_before,"
+          "blocks_after,dt,pdt,li,layout,df,pdf\n");
+  for (const PassRecord &R : Records) {
+    fprintf(Out, "%s,", R.Pass);
+    _WriteCSVString(Out, R.Function);
+    fprintf(Out, ",%.9f,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u\n",
+            R.Seconds, R.InstsBefore, R.InstsAfter, R.BlocksBefore, R.BlocksAfter,
+            R.Analyses.DT, R.Analyses.PDT, R.Analyses.LI, R.Analyses.Layout,
+            R.Analyses.DF, R.Analyses.PDF);
+  }
+}
+
+void WriteProfile()
+{
+  const char *Path = _ProfilePath();
+  if (Path == nullptr)
+    return;
+
+  FILE *Out = fopen(Path, "w");
+  if (Out == nullptr) {
+    fprintf(stderr, "CSE: cannot write profile to %s\n", Path);
+  } else {
+    if (StringRef(Path).endswith(".csv"))
+      _WriteCSV(Out, CSEStats.Profile);
+    else
+      _WriteJSON(Out, CSEStats.Profile);
+    fclose(Out);
+  }
+
+  CSEStats.Profile.clear();
+}
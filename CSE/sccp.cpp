@@ -0,0 +1,342 @@
+/*
+ * File: sccp.cpp
+ *
+ * Description:
+ *   Sparse conditional constant propagation.  Every value starts out
+ *   unknown and only blocks proven executable are evaluated, so constants
+ *   flow through phis and branches that would stop a purely local folder.
+ *   Conditional branches on a constant are then rewritten into plain
+ *   branches and blocks that are no longer reachable are deleted.
+ */
+
+/* LLVM Header Files */
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Value.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/SmallVector.h"
+#include <vector>
+#include "dominance.h"
+
+using namespace llvm;
+#include "CSE.h"
+
+namespace {
+
+struct LatticeValue {
+  enum { Unknown, Constant, Overdefined } State = Unknown;
+  ConstantInt *C = nullptr;
+};
+
+class SCCPSolver {
+public:
+  void solve(Function &F);
+
+  bool isExecutable(BasicBlock *BB) const { return Executable.count(BB); }
+
+  LatticeValue getValue(Value *V) {
+    if (ConstantInt *C = dyn_cast<ConstantInt>(V))
+      return {LatticeValue::Constant, C};
+    if (isa<Instruction>(V))
+      return Values[V];
+    // arguments, globals, undef and friends could be anything
+    return {LatticeValue::Overdefined, nullptr};
+  }
+
+private:
+  void markConstant(Instruction *I, ConstantInt *C);
+  void markOverdefined(Instruction *I);
+  void markEdgeExecutable(BasicBlock *From, BasicBlock *To);
+
+  void visit(Instruction &I);
+  void visitPHI(PHINode &PN);
+  void visitTerminator(Instruction &I);
+  void visitSelect(SelectInst &SI);
+
+  DenseMap<Value*, LatticeValue> Values;
+  SmallPtrSet<BasicBlock*, 16> Executable;
+  DenseSet<std::pair<BasicBlock*, BasicBlock*>> ExecutableEdges;
+
+  SmallVector<BasicBlock*, 16> BlockWorklist;
+  SmallVector<Instruction*, 64> InstWorklist;
+};
+
+} // end anonymous namespace
+
+void SCCPSolver::markConstant(Instruction *I, ConstantInt *C)
+{
+  LatticeValue &LV = Values[I];
+  // values only ever move down the lattice
+  if (LV.State != LatticeValue::Unknown)
+    return;
+  LV.State = LatticeValue::Constant;
+  LV.C = C;
+  InstWorklist.push_back(I);
+}
+
+void SCCPSolver::markOverdefined(Instruction *I)
+{
+  LatticeValue &LV = Values[I];
+  if (LV.State == LatticeValue::Overdefined)
+    return;
+  LV.State = LatticeValue::Overdefined;
+  LV.C = nullptr;
+  InstWorklist.push_back(I);
+}
+
+void SCCPSolver::markEdgeExecutable(BasicBlock *From, BasicBlock *To)
+{
+  if (!ExecutableEdges.insert(std::make_pair(From, To)).second)
+    return;
+
+  if (Executable.insert(To).second) {
+    BlockWorklist.push_back(To);
+  } else {
+    // a new way into To: its phis must take the new edge into account
+    for (PHINode &PN : To->phis())
+      visitPHI(PN);
+  }
+}
+
+void SCCPSolver::visitPHI(PHINode &PN)
+{
+  if (!PN.getType()->isIntegerTy())
+    return markOverdefined(&PN);
+
+  ConstantInt *Common = nullptr;
+  for (unsigned i = 0; i < PN.getNumIncomingValues(); i++) {
+    if (!ExecutableEdges.count(std::make_pair(PN.getIncomingBlock(i), PN.getParent())))
+      continue;
+
+    LatticeValue LV = getValue(PN.getIncomingValue(i));
+    if (LV.State == LatticeValue::Unknown)
+      continue;
+    if (LV.State == LatticeValue::Overdefined || (Common && Common != LV.C))
+      return markOverdefined(&PN);
+    Common = LV.C;
+  }
+
+  if (Common)
+    markConstant(&PN, Common);
+}
+
+void SCCPSolver::visitTerminator(Instruction &I)
+{
+  BasicBlock *BB = I.getParent();
+
+  if (BranchInst *BI = dyn_cast<BranchInst>(&I)) {
+    if (BI->isConditional()) {
+      LatticeValue Cond = getValue(BI->getCondition());
+      if (Cond.State == LatticeValue::Unknown)
+        return;
+      if (Cond.State == LatticeValue::Constant) {
+        markEdgeExecutable(BB, BI->getSuccessor(Cond.C->isOne() ? 0 : 1));
+        return;
+      }
+    }
+  } else if (SwitchInst *SI = dyn_cast<SwitchInst>(&I)) {
+    LatticeValue Cond = getValue(SI->getCondition());
+    if (Cond.State == LatticeValue::Unknown)
+      return;
+    if (Cond.State == LatticeValue::Constant) {
+      markEdgeExecutable(BB, SI->findCaseValue(Cond.C)->getCaseSuccessor());
+      return;
+    }
+  }
+
+  for (BasicBlock *Succ : successors(BB))
+    markEdgeExecutable(BB, Succ);
+}
+
+void SCCPSolver::visitSelect(SelectInst &SI)
+{
+  LatticeValue Cond = getValue(SI.getCondition());
+  if (Cond.State == LatticeValue::Unknown)
+    return;
+
+  if (Cond.State == LatticeValue::Constant) {
+    LatticeValue V = getValue(Cond.C->isOne() ? SI.getTrueValue() : SI.getFalseValue());
+    if (V.State == LatticeValue::Constant)
+      markConstant(&SI, V.C);
+    else if (V.State == LatticeValue::Overdefined)
+      markOverdefined(&SI);
+    return;
+  }
+
+  // either arm may be chosen, so both must agree
+  LatticeValue T = getValue(SI.getTrueValue());
+  LatticeValue F = getValue(SI.getFalseValue());
+  if (T.State == LatticeValue::Overdefined || F.State == LatticeValue::Overdefined ||
+      (T.State == LatticeValue::Constant && F.State == LatticeValue::Constant && T.C != F.C))
+    markOverdefined(&SI);
+  else if (T.State == LatticeValue::Constant && F.State == LatticeValue::Constant)
+    markConstant(&SI, T.C);
+}
+
+void SCCPSolver::visit(Instruction &I)
+{
+  if (Values[&I].State == LatticeValue::Overdefined)
+    return;
+
+  if (PHINode *PN = dyn_cast<PHINode>(&I))
+    return visitPHI(*PN);
+  if (I.isTerminator())
+    return visitTerminator(I);
+  if (!I.getType()->isIntegerTy())
+    return markOverdefined(&I);
+  if (SelectInst *SI = dyn_cast<SelectInst>(&I))
+    return visitSelect(*SI);
+
+  if (!isa<BinaryOperator>(I) && !isa<ICmpInst>(I) && !isa<CastInst>(I))
+    return markOverdefined(&I);
+
+  SmallVector<ConstantInt*, 2> Ops;
+  for (Value *Op : I.operands()) {
+    LatticeValue LV = getValue(Op);
+    if (LV.State == LatticeValue::Overdefined)
+      return markOverdefined(&I);
+    if (LV.State == LatticeValue::Unknown)
+      return;
+    Ops.push_back(LV.C);
+  }
+
+  APInt Result;
+  if (ICmpInst *CI = dyn_cast<ICmpInst>(&I)) {
+    bool Taken = ICmpInst::compare(Ops[0]->getValue(), Ops[1]->getValue(), CI->getPredicate());
+    return markConstant(&I, ConstantInt::get(I.getContext(), APInt(1, Taken)));
+  }
+
+  bool Folded = isa<CastInst>(I)
+    ? _FoldCast(I.getOpcode(), Ops[0]->getValue(), I.getType()->getIntegerBitWidth(), Result)
+    : _FoldBinaryOperator(I.getOpcode(), Ops[0]->getValue(), Ops[1]->getValue(), Result);
+
+  if (Folded)
+    markConstant(&I, ConstantInt::get(I.getContext(), Result));
+  else
+    markOverdefined(&I);
+}
+
+void SCCPSolver::solve(Function &F)
+{
+  BasicBlock *Entry = &F.getEntryBlock();
+  Executable.insert(Entry);
+  BlockWorklist.push_back(Entry);
+
+  while (!BlockWorklist.empty() || !InstWorklist.empty()) {
+    // values settle faster if their users are revisited first
+    while (!InstWorklist.empty()) {
+      Instruction *I = InstWorklist.pop_back_val();
+      for (User *U : I->users()) {
+        Instruction *UI = cast<Instruction>(U);
+        if (isExecutable(UI->getParent()))
+          visit(*UI);
+      }
+    }
+
+    if (!BlockWorklist.empty()) {
+      BasicBlock *BB = BlockWorklist.pop_back_val();
+      for (Instruction &I : *BB)
+        visit(I);
+    }
+  }
+}
+
+static void _DeleteUnreachableBlocks(Function &F)
+{
+  LLVMValueRef Fun = wrap(&F);
+  std::vector<BasicBlock*> Dead;
+
+  for (BasicBlock &BB : F)
+    if (!LLVMIsReachableFromEntry(Fun, wrap(&BB)))
+      Dead.push_back(&BB);
+
+  for (BasicBlock *BB : Dead) {
+    for (BasicBlock *Succ : successors(BB))
+      Succ->removePredecessor(BB);
+    BB->dropAllReferences();
+  }
+
+  for (BasicBlock *BB : Dead) {
+    BB->eraseFromParent();
+    CSEStats.Unreach++;
+  }
+}
+
+static void _RunSparseConditionalConstantPropagation(Function &F)
+{
+  if (F.isDeclaration())
+    return;
+
+  SCCPSolver Solver;
+  Solver.solve(F);
+
+  bool ChangedCFG = false;
+
+  for (BasicBlock &BB : F) {
+    if (!Solver.isExecutable(&BB))
+      continue;
+
+    for (Instruction &I : make_early_inc_range(BB)) {
+      if (I.isTerminator() || I.getType()->isVoidTy())
+        continue;
+
+      LatticeValue LV = Solver.getValue(&I);
+      if (LV.State != LatticeValue::Constant)
+        continue;
+
+      I.replaceAllUsesWith(LV.C);
+      I.eraseFromParent();
+      CSEStats.Simplify++;
+    }
+
+    // only the successor the solver followed can be taken
+    Instruction *Term = BB.getTerminator();
+    BasicBlock *Taken = nullptr;
+    if (BranchInst *BI = dyn_cast<BranchInst>(Term)) {
+      if (BI->isConditional())
+        if (ConstantInt *C = dyn_cast<ConstantInt>(BI->getCondition()))
+          Taken = BI->getSuccessor(C->isOne() ? 0 : 1);
+    } else if (SwitchInst *SI = dyn_cast<SwitchInst>(Term)) {
+      if (ConstantInt *C = dyn_cast<ConstantInt>(SI->getCondition()))
+        Taken = SI->findCaseValue(C)->getCaseSuccessor();
+    }
+
+    if (Taken == nullptr)
+      continue;
+
+    // phis have an entry per edge, not per successor, and the new br
+    // keeps exactly one of the edges to Taken
+    bool KeptTaken = false;
+    for (BasicBlock *Succ : successors(&BB)) {
+      if (Succ == Taken && !KeptTaken)
+        KeptTaken = true;
+      else
+        Succ->removePredecessor(&BB);
+    }
+
+    BranchInst::Create(Taken, Term);
+    Term->eraseFromParent();
+    ChangedCFG = true;
+  }
+
+  if (ChangedCFG) {
+    LLVMInvalidateDominance(wrap(&F));
+    _DeleteUnreachableBlocks(F);
+    LLVMInvalidateDominance(wrap(&F));
+  }
+}
+
+void RunSparseConditionalConstantPropagation(Module &M)
+{
+  for (Module::iterator f = M.begin(); f != M.end(); f++) {
+    PassProfile Profile("sccp", *f);
+    _RunSparseConditionalConstantPropagation(*f);
+  }
+}
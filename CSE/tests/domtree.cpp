@@ -0,0 +1,93 @@
+/*
+ * File: domtree.cpp
+ *
+ * Description:
+ *   Checks the child iteration of the flattened dominator tree against
+ *   LLVM's own DominatorTree: walking LLVMFirstDomChild and
+ *   LLVMNextDomChild visits exactly each block's children, and asking
+ *   for the sibling after a block that is not a child of BB gives NULL.
+ */
+
+#include <stdio.h>
+
+/* LLVM Header Files */
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/AsmParser/Parser.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/raw_ostream.h"
+#include <vector>
+#include "../dominance.h"
+
+using namespace llvm;
+#include "../CSE.h"
+
+/* entry has children a, b and exit; a and b have two children each */
+static const char *TwoLevelTree = R"(
+define void @f(i1 %c) {
+entry:
+  br i1 %c, label %a, label %b
+a:
+  br i1 %c, label %a1, label %a2
+a1:
+  br label %exit
+a2:
+  br label %exit
+b:
+  br i1 %c, label %b1, label %b2
+b1:
+  br label %exit
+b2:
+  br label %exit
+exit:
+  ret void
+}
+)";
+
+int main()
+{
+  LLVMContext Context;
+  SMDiagnostic Err;
+  std::unique_ptr<Module> M = parseAssemblyString(TwoLevelTree, Err, Context);
+  if (!M) {
+    Err.print("domtree", errs());
+    return 1;
+  }
+
+  Function *F = M->getFunction("f");
+  DominatorTree DT(*F);
+  int Failures = 0;
+
+  for (BasicBlock &P : *F) {
+    std::vector<BasicBlock*> Expected;
+    for (DomTreeNode *N : DT.getNode(&P)->children())
+      Expected.push_back(N->getBlock());
+
+    std::vector<BasicBlock*> Walked;
+    for (LLVMBasicBlockRef C = LLVMFirstDomChild(wrap(&P)); C != NULL;
+         C = LLVMNextDomChild(wrap(&P), C))
+      Walked.push_back(unwrap(C));
+
+    if (Walked != Expected) {
+      printf("FAIL: children of %s\n", P.getName().str().c_str());
+      Failures++;
+    }
+
+    // only a child of P has a next sibling under P
+    for (BasicBlock &C : *F) {
+      if (DT.getNode(&C)->getIDom() && DT.getNode(&C)->getIDom()->getBlock() == &P)
+        continue;
+      if (LLVMNextDomChild(wrap(&P), wrap(&C)) != NULL) {
+        printf("FAIL: %s is not a child of %s but has a sibling there\n",
+               C.getName().str().c_str(), P.getName().str().c_str());
+        Failures++;
+      }
+    }
+  }
+
+  LLVMClearDominanceCache();
+  printf("%s: dominator tree children\n", Failures ? "FAIL" : "PASS");
+  return Failures != 0;
+}
@@ -0,0 +1,142 @@
+/*
+ * File: dse.cpp
+ *
+ * Description:
+ *   Regression cases for dead store elimination on tracked allocas.
+ *   Each function is parsed from text and run through the pass, and the
+ *   stores left are counted: a store no path reads before the alloca is
+ *   overwritten or the function returns must go, and any other must stay.
+ */
+
+#include <stdio.h>
+
+/* LLVM Header Files */
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/AsmParser/Parser.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/raw_ostream.h"
+#include "../dominance.h"
+
+using namespace llvm;
+#include "../CSE.h"
+
+/* The second store comes after the alloca's last read */
+static const char *StoreAfterLastRead = R"(
+define i64 @f(i64 %a) {
+entry:
+  %x = alloca i64
+  store i64 %a, i64* %x
+  %v = load i64, i64* %x
+  %w = add i64 %v, 1
+  store i64 %w, i64* %x
+  br label %exit
+exit:
+  ret i64 %w
+}
+)";
+
+/* Read on one path only, so the store stays */
+static const char *ReadOnOnePath = R"(
+define i64 @f(i64 %a, i1 %c) {
+entry:
+  %x = alloca i64
+  store i64 %a, i64* %x
+  br i1 %c, label %read, label %exit
+read:
+  %v = load i64, i64* %x
+  ret i64 %v
+exit:
+  ret i64 0
+}
+)";
+
+/* Read by the next iteration of a loop, so the store in it stays */
+static const char *ReadAroundLoop = R"(
+define i64 @f(i64 %n) {
+entry:
+  %x = alloca i64
+  store i64 0, i64* %x
+  br label %loop
+loop:
+  %v = load i64, i64* %x
+  %w = add i64 %v, 1
+  store i64 %w, i64* %x
+  %c = icmp slt i64 %w, %n
+  br i1 %c, label %loop, label %exit
+exit:
+  ret i64 %w
+}
+)";
+
+/* Overwritten in both successors before either reads it */
+static const char *OverwrittenOnEveryPath = R"(
+define i64 @f(i64 %a, i1 %c) {
+entry:
+  %x = alloca i64
+  store i64 %a, i64* %x
+  br i1 %c, label %left, label %right
+left:
+  store i64 1, i64* %x
+  br label %exit
+right:
+  store i64 2, i64* %x
+  br label %exit
+exit:
+  %v = load i64, i64* %x
+  ret i64 %v
+}
+)";
+
+struct Case {
+  const char *Name;
+  const char *IR;
+  unsigned Stores;      // left after the pass
+};
+
+static const Case Cases[] = {
+  { "store after the last read",          StoreAfterLastRead,     1 },
+  { "store read on one path",             ReadOnOnePath,          1 },
+  { "store read around a loop",           ReadAroundLoop,         2 },
+  { "store overwritten on every path",    OverwrittenOnEveryPath, 2 },
+};
+
+static bool _Run(const Case &C)
+{
+  LLVMContext Context;
+  SMDiagnostic Err;
+  std::unique_ptr<Module> M = parseAssemblyString(C.IR, Err, Context);
+  if (!M) {
+    Err.print(C.Name, errs());
+    return false;
+  }
+
+  RunDeadStoreElimination(*M);
+  LLVMClearDominanceCache();
+
+  Function *F = M->getFunction("f");
+  unsigned Stores = 0;
+  for (Instruction &I : instructions(F))
+    Stores += isa<StoreInst>(I);
+
+  if (verifyModule(*M, &errs()) || Stores != C.Stores) {
+    F->print(errs());
+    return false;
+  }
+  return true;
+}
+
+int main()
+{
+  int Failures = 0;
+  for (const Case &C : Cases) {
+    bool Passed = _Run(C);
+    printf("%s: %s\n", Passed ? "PASS" : "FAIL", C.Name);
+    Failures += !Passed;
+  }
+  return Failures != 0;
+}
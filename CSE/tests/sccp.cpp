@@ -0,0 +1,116 @@
+/*
+ * File: sccp.cpp
+ *
+ * Description:
+ *   Regression cases for folding terminators in sparse conditional
+ *   constant propagation.  Each function is parsed from text, run
+ *   through the pass and checked with the verifier, which rejects phis
+ *   that keep entries for edges the folded terminator no longer has.
+ */
+
+#include <stdio.h>
+
+/* LLVM Header Files */
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/AsmParser/Parser.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/raw_ostream.h"
+#include "../dominance.h"
+
+using namespace llvm;
+#include "../CSE.h"
+
+/* A switch on a constant with several cases going to the block it takes
+   and several to a block that stays reachable from elsewhere */
+static const char *SwitchDuplicateTargets = R"(
+define i64 @f(i64 %a) {
+entry:
+  %c = icmp eq i64 %a, 0
+  br i1 %c, label %sw, label %untaken
+sw:
+  switch i64 2, label %untaken [ i64 1, label %untaken
+                                 i64 2, label %taken
+                                 i64 3, label %untaken
+                                 i64 4, label %taken ]
+untaken:
+  %u = phi i64 [ %a, %entry ], [ 7, %sw ], [ 7, %sw ], [ 7, %sw ]
+  ret i64 %u
+taken:
+  %t = phi i64 [ %a, %sw ], [ %a, %sw ]
+  %r = add i64 %t, %a
+  ret i64 %r
+}
+)";
+
+/* A conditional branch on a constant whose two edges go to one block */
+static const char *BranchSameTarget = R"(
+define i64 @f(i64 %a) {
+entry:
+  br i1 true, label %join, label %join
+join:
+  %j = phi i64 [ %a, %entry ], [ %a, %entry ]
+  %r = add i64 %j, 1
+  ret i64 %r
+}
+)";
+
+struct Case {
+  const char *Name;
+  const char *IR;
+};
+
+static const Case Cases[] = {
+  { "switch with duplicate case targets", SwitchDuplicateTargets },
+  { "branch with both edges to one block", BranchSameTarget      },
+};
+
+/* The pass must have turned every branch on a constant into a plain br */
+static bool _IsFolded(Function &F)
+{
+  for (BasicBlock &BB : F) {
+    Instruction *Term = BB.getTerminator();
+    if (isa<SwitchInst>(Term))
+      return false;
+    if (BranchInst *BI = dyn_cast<BranchInst>(Term))
+      if (BI->isConditional() && isa<ConstantInt>(BI->getCondition()))
+        return false;
+  }
+  return true;
+}
+
+static bool _Run(const Case &C)
+{
+  LLVMContext Context;
+  SMDiagnostic Err;
+  std::unique_ptr<Module> M = parseAssemblyString(C.IR, Err, Context);
+  if (!M) {
+    Err.print(C.Name, errs());
+    return false;
+  }
+
+  RunSparseConditionalConstantPropagation(*M);
+  LLVMClearDominanceCache();
+
+  Function *F = M->getFunction("f");
+  if (verifyModule(*M, &errs()) || !_IsFolded(*F)) {
+    F->print(errs());
+    return false;
+  }
+  return true;
+}
+
+int main()
+{
+  int Failures = 0;
+  for (const Case &C : Cases) {
+    bool Passed = _Run(C);
+    printf("%s: %s\n", Passed ? "PASS" : "FAIL", C.Name);
+    Failures += !Passed;
+  }
+  return Failures != 0;
+}